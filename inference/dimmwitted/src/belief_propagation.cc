@@ -0,0 +1,212 @@
+#include "belief_propagation.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace dd {
+
+// normalizes the log probabilities at [begin, end) to sum to one
+static inline void log_normalize(double *begin, double *end) {
+  double sum = -INFINITY;
+  for (double *p = begin; p != end; ++p) sum = logadd(sum, *p);
+  for (double *p = begin; p != end; ++p) *p -= sum;
+}
+
+// calls fn(begin, end) with n_threads equal ranges of [0, num) in parallel,
+// and returns the largest value they return
+template <typename F>
+static double run_in_parallel(size_t num, size_t n_threads, F fn) {
+  std::vector<double> results(n_threads, 0);
+  std::vector<std::thread> threads;
+  size_t chunk = num / n_threads + 1;
+  for (size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(std::thread([&fn, &results, num, chunk, t]() {
+      results[t] =
+          fn(std::min(num, chunk * t), std::min(num, chunk * (t + 1)));
+    }));
+  }
+  for (auto &t : threads) t.join();
+  return *std::max_element(results.begin(), results.end());
+}
+
+BeliefPropagation::BeliefPropagation(const FactorGraph &fg,
+                                     bool should_sample_evidence)
+    : fg_(fg),
+      is_query_(fg.size.num_variables, false),
+      msg_base_(fg.size.num_edges + 1, 0),
+      edge_base_(fg.size.num_variables + 1, 0),
+      belief_base_(fg.size.num_variables + 1, 0) {
+  const size_t nvar = fg.size.num_variables;
+  const size_t nedge = fg.size.num_edges;
+  for (size_t vid = 0; vid < nvar; ++vid) {
+    const Variable &variable = fg.variables[vid];
+    is_query_[vid] = should_sample_evidence || !variable.is_evid;
+    belief_base_[vid + 1] =
+        belief_base_[vid] + (is_query_[vid] ? variable.cardinality : 0);
+  }
+  beliefs_.resize(belief_base_[nvar]);
+  for (size_t vid = 0; vid < nvar; ++vid) {
+    for (size_t i = belief_base_[vid]; i < belief_base_[vid + 1]; ++i)
+      beliefs_[i] = 1.0 / fg.variables[vid].cardinality;
+  }
+
+  // messages start uniform, i.e., all zeros in the log domain
+  for (size_t i = 0; i < nedge; ++i) {
+    size_t vid = fg.vifs[i].vid;
+    msg_base_[i + 1] =
+        msg_base_[i] + (is_query_[vid] ? fg.variables[vid].cardinality : 0);
+    if (is_query_[vid]) ++edge_base_[vid + 1];
+  }
+  factor_msgs_.assign(msg_base_[nedge], 0);
+  var_msgs_.assign(msg_base_[nedge], 0);
+
+  // group the vifs by variable
+  for (size_t vid = 0; vid < nvar; ++vid)
+    edge_base_[vid + 1] += edge_base_[vid];
+  edges_.resize(edge_base_[nvar]);
+  std::vector<size_t> next(edge_base_.begin(), edge_base_.end() - 1);
+  for (size_t i = 0; i < nedge; ++i) {
+    size_t vid = fg.vifs[i].vid;
+    if (is_query_[vid]) edges_[next[vid]++] = i;
+  }
+}
+
+size_t BeliefPropagation::run(const InferenceResult &infrs,
+                              size_t max_iterations, double damping,
+                              double tolerance, size_t n_threads) {
+  size_t i_iteration = 0;
+  while (i_iteration < max_iterations) {
+    ++i_iteration;
+    run_in_parallel(fg_.size.num_factors, n_threads,
+                    [this, &infrs, damping](size_t begin, size_t end) {
+                      update_factor_msgs(infrs, begin, end, damping);
+                      return 0.0;
+                    });
+    double delta = run_in_parallel(
+        fg_.size.num_variables, n_threads,
+        [this](size_t begin, size_t end) {
+          return update_var_msgs(begin, end);
+        });
+    if (tolerance > 0 && delta <= tolerance) break;
+  }
+  return i_iteration;
+}
+
+void BeliefPropagation::update_factor_msgs(const InferenceResult &infrs,
+                                           size_t begin, size_t end,
+                                           double damping) {
+  // a copy of each factor over its own vifs and assignments, indexed by the
+  // positions of its variables, so enumerating never touches shared state
+  std::vector<FactorToVariable> vifs;
+  std::vector<size_t> assignments;
+  std::vector<size_t> query_positions;
+  std::vector<double> new_msgs;
+  for (size_t factor_id = begin; factor_id < end; ++factor_id) {
+    Factor factor(fg_.factors[factor_id]);
+    const size_t vif_base = factor.vif_base;
+    vifs.resize(factor.num_vars);
+    assignments.resize(factor.num_vars);
+    query_positions.clear();
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const FactorToVariable &vif = fg_.vifs[vif_base + j];
+      vifs[j] = FactorToVariable(j, vif.dense_equal_to);
+      assignments[j] = infrs.assignments_evid[vif.vid];
+      if (is_query_[vif.vid]) {
+        query_positions.push_back(j);
+        assignments[j] = 0;
+      }
+    }
+    if (query_positions.empty()) continue;
+    factor.vif_base = 0;
+    const double weight = infrs.weight_values[factor.weight_id];
+
+    // sum out the rest from each joint assignment to the query variables,
+    // weighted by the messages they sent
+    const double *msgs_in = &var_msgs_[msg_base_[vif_base]];
+    new_msgs.assign(msg_base_[vif_base + factor.num_vars] - msg_base_[vif_base],
+                    -INFINITY);
+    bool has_next = true;
+    while (has_next) {
+      double total = weight * factor.potential(vifs.data(), assignments.data());
+      for (size_t j : query_positions) {
+        size_t offset = msg_base_[vif_base + j] - msg_base_[vif_base];
+        total += msgs_in[offset + assignments[j]];
+      }
+      for (size_t j : query_positions) {
+        size_t offset = msg_base_[vif_base + j] - msg_base_[vif_base] +
+                        assignments[j];
+        new_msgs[offset] = logadd(new_msgs[offset], total - msgs_in[offset]);
+      }
+      // next joint assignment like an odometer
+      has_next = false;
+      for (size_t j : query_positions) {
+        size_t vid = fg_.vifs[vif_base + j].vid;
+        if (++assignments[j] < fg_.variables[vid].cardinality) {
+          has_next = true;
+          break;
+        }
+        assignments[j] = 0;
+      }
+    }
+
+    // damp the normalized messages toward the previous ones
+    for (size_t j : query_positions) {
+      size_t offset = msg_base_[vif_base + j] - msg_base_[vif_base];
+      size_t size = msg_base_[vif_base + j + 1] - msg_base_[vif_base + j];
+      log_normalize(&new_msgs[offset], &new_msgs[offset + size]);
+      double *msgs = &factor_msgs_[msg_base_[vif_base + j]];
+      for (size_t k = 0; k < size; ++k)
+        msgs[k] = (1 - damping) * new_msgs[offset + k] + damping * msgs[k];
+    }
+  }
+}
+
+double BeliefPropagation::update_var_msgs(size_t begin, size_t end) {
+  std::vector<double> log_belief;
+  double max_delta = 0;
+  for (size_t vid = begin; vid < end; ++vid) {
+    if (!is_query_[vid]) continue;
+    const size_t cardinality = fg_.variables[vid].cardinality;
+    log_belief.assign(cardinality, 0);
+    for (size_t i = edge_base_[vid]; i < edge_base_[vid + 1]; ++i) {
+      const double *msgs = &factor_msgs_[msg_base_[edges_[i]]];
+      for (size_t k = 0; k < cardinality; ++k) log_belief[k] += msgs[k];
+    }
+
+    // each factor gets the belief without its own message
+    for (size_t i = edge_base_[vid]; i < edge_base_[vid + 1]; ++i) {
+      const double *msgs_in = &factor_msgs_[msg_base_[edges_[i]]];
+      double *msgs_out = &var_msgs_[msg_base_[edges_[i]]];
+      for (size_t k = 0; k < cardinality; ++k)
+        msgs_out[k] = log_belief[k] - msgs_in[k];
+      log_normalize(msgs_out, msgs_out + cardinality);
+    }
+
+    log_normalize(log_belief.data(), log_belief.data() + cardinality);
+    double *belief = &beliefs_[belief_base_[vid]];
+    for (size_t k = 0; k < cardinality; ++k) {
+      double prob = exp(log_belief[k]);
+      max_delta = std::max(max_delta, std::abs(prob - belief[k]));
+      belief[k] = prob;
+    }
+  }
+  return max_delta;
+}
+
+void BeliefPropagation::store_marginals(InferenceResult &infrs) const {
+  for (size_t vid = 0; vid < fg_.size.num_variables; ++vid) {
+    if (!is_query_[vid] || infrs.agg_nsamples[vid] > 0) continue;
+    const Variable &variable = fg_.variables[vid];
+    const double *belief = &beliefs_[belief_base_[vid]];
+    infrs.agg_nsamples[vid] = 1;
+    for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+      // a boolean var only tallies its true value
+      size_t value = variable.is_boolean() ? 1 : k;
+      infrs.sample_tallies[variable.var_val_base + k] = belief[value];
+    }
+  }
+}
+
+}  // namespace dd
@@ -0,0 +1,73 @@
+#ifndef DIMMWITTED_BELIEF_PROPAGATION_H_
+#define DIMMWITTED_BELIEF_PROPAGATION_H_
+
+#include "factor_graph.h"
+#include "inference_result.h"
+
+#include <vector>
+
+namespace dd {
+
+/**
+ * Loopy belief propagation over the query variables of a factor graph, with
+ * the evidence clamped to its values, as an approximate but much cheaper
+ * alternative to sampling for the marginals.
+ *
+ * Messages are kept in the log domain, one for each query variable of each
+ * factor (i.e., for each of its vifs) in either direction, and are updated
+ * in parallel (flooding), damped by mixing in the previous ones.  Factors are
+ * marginalized by enumerating the joint assignments to their query
+ * variables, so the cost grows exponentially with their query arity.
+ */
+class BeliefPropagation {
+ public:
+  /**
+   * Prepares the messages for the given (indexed) factor graph, treating
+   * evidence as query variables too if should_sample_evidence.
+   */
+  BeliefPropagation(const FactorGraph &fg, bool should_sample_evidence);
+
+  /**
+   * Propagates messages given the weights and evidence in infrs for up to
+   * max_iterations, or until no marginal changes more than tolerance (if
+   * positive) in an iteration, using n_threads threads, and returns the
+   * number of iterations done.
+   */
+  size_t run(const InferenceResult &infrs, size_t max_iterations,
+             double damping, double tolerance, size_t n_threads);
+
+  /**
+   * Stores the beliefs of the query variables whose marginals are not
+   * computed yet (i.e., with no samples tallied) into infrs as if each was
+   * sampled once with fractional tallies.
+   */
+  void store_marginals(InferenceResult &infrs) const;
+
+ private:
+  const FactorGraph &fg_;
+  std::vector<bool> is_query_;
+  // messages of each vif (empty for evidence) at [msg_base_[i],
+  // msg_base_[i + 1]), from its factor to its variable, and the other way
+  std::vector<size_t> msg_base_;
+  std::vector<double> factor_msgs_;
+  std::vector<double> var_msgs_;
+  // vifs of each query variable at [edge_base_[vid], edge_base_[vid + 1])
+  std::vector<size_t> edges_;
+  std::vector<size_t> edge_base_;
+  // normalized belief of each query variable at [belief_base_[vid],
+  // belief_base_[vid + 1])
+  std::vector<size_t> belief_base_;
+  std::vector<double> beliefs_;
+
+  // updates the messages from the factors [begin, end) to their variables
+  void update_factor_msgs(const InferenceResult &infrs, size_t begin,
+                          size_t end, double damping);
+
+  // updates the beliefs of the variables [begin, end) and the messages from
+  // them to their factors, and returns the largest change of a belief
+  double update_var_msgs(size_t begin, size_t end);
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_BELIEF_PROPAGATION_H_
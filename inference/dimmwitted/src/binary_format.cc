@@ -8,8 +8,10 @@
 #include "common.h"
 #include "factor.h"
 #include "factor_graph.h"
+#include "inference_result.h"
 #include "variable.h"
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
@@ -69,6 +71,136 @@ void FactorGraph::load_weights(const std::vector<std::string> &filenames) {
   });
 }
 
+void FactorGraph::load_weight_values(
+    const std::vector<std::string> &filenames) {
+  parallel_load(filenames, [this](const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    while (file && file.peek() != EOF) {
+      // read fields
+      size_t wid;
+      uint8_t isfixed;
+      double value;
+      read_be_or_die(file, wid);
+      read_be_or_die(file, isfixed);
+      read_be_or_die(file, value);
+      if (wid >= size.num_weights) {
+        std::cerr << "[ERROR] Weight " << wid << " in " << filename
+                  << " is not in the factor graph" << std::endl;
+        std::abort();
+      }
+      // keep whether it is fixed as defined by the factor graph
+      weights[wid].weight = value;
+    }
+  });
+}
+
+// puts value in big endian at p, returning where the next one goes
+static inline char *put_be64(char *p, uint64_t value) {
+  value = htobe64(value);
+  memcpy(p, &value, sizeof(value));
+  return p + sizeof(value);
+}
+
+// writes num records of at most record_size bytes each, which serialize(p, i)
+// puts at p for the i-th record, through a large buffer to keep the number of
+// writes low
+template <typename F>
+static void write_records(std::ostream &output, size_t num,
+                          size_t record_size, F serialize) {
+  constexpr size_t NUM_RECORDS_PER_WRITE = 1 << 16;
+  std::unique_ptr<char[]> buf(new char[record_size * NUM_RECORDS_PER_WRITE]);
+  for (size_t j = 0; j < num; j += NUM_RECORDS_PER_WRITE) {
+    size_t end = std::min(num, j + NUM_RECORDS_PER_WRITE);
+    char *p = buf.get();
+    for (size_t i = j; i < end; ++i) p = serialize(p, i);
+    output.write(buf.get(), p - buf.get());
+  }
+}
+
+void InferenceResult::dump_weights_in_binary(
+    std::ostream &binary_output) const {
+  write_records(binary_output, nweights, sizeof(uint64_t) + 1 + sizeof(double),
+                [this](char *p, size_t wid) {
+                  double value = weight_values[wid];
+                  p = put_be64(p, wid);
+                  *p++ = weights_isfixed[wid];
+                  return put_be64(p, *(uint64_t *)&value);
+                });
+}
+
+// domain value of the given dense value, which the chains file stores
+static inline size_t chain_value(const FactorGraph &fg,
+                                 const Variable &variable, size_t dense) {
+  return variable.is_boolean() ? dense : fg.get_var_value_at(variable, dense);
+}
+
+// dense value of the given value from the chains file, or
+// Variable::INVALID_VALUE if it is out of the domain
+static inline size_t chain_dense_value(const FactorGraph &fg,
+                                       const Variable &variable,
+                                       size_t value) {
+  if (variable.domain_map) {
+    auto it = variable.domain_map->find(value);
+    return it == variable.domain_map->end() ? Variable::INVALID_VALUE
+                                            : it->second.index;
+  }
+  if (variable.is_boolean())
+    return value < variable.cardinality ? value : Variable::INVALID_VALUE;
+  // the domain values are in the index once the domain_map is reclaimed
+  for (size_t i = 0; i < variable.cardinality; ++i)
+    if (fg.get_var_value_at(variable, i) == value) return i;
+  return Variable::INVALID_VALUE;
+}
+
+void InferenceResult::dump_chains_in_binary(std::ostream &binary_output) const {
+  write_records(binary_output, nvars, 3 * sizeof(uint64_t),
+                [this](char *p, size_t vid) {
+                  const Variable &variable = fg.variables[vid];
+                  p = put_be64(p, fg.original_vid(vid));
+                  p = put_be64(p, chain_value(fg, variable,
+                                              assignments_free[vid]));
+                  return put_be64(p, chain_value(fg, variable,
+                                                 assignments_evid[vid]));
+                });
+}
+
+void InferenceResult::load_chains(const std::vector<std::string> &filenames) {
+  parallel_load(filenames, [this](const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    while (file && file.peek() != EOF) {
+      // read fields
+      size_t original_vid;
+      size_t value_free;
+      size_t value_evid;
+      read_be_or_die(file, original_vid);
+      read_be_or_die(file, value_free);
+      read_be_or_die(file, value_evid);
+      if (original_vid >= nvars) {
+        std::cerr << "[ERROR] Variable " << original_vid << " in " << filename
+                  << " is not in the factor graph" << std::endl;
+        std::abort();
+      }
+      const size_t vid = fg.reordered_vid(original_vid);
+      const Variable &variable = fg.variables[vid];
+      size_t dense_free = chain_dense_value(fg, variable, value_free);
+      size_t dense_evid = chain_dense_value(fg, variable, value_evid);
+      if (dense_free == Variable::INVALID_VALUE ||
+          dense_evid == Variable::INVALID_VALUE) {
+        std::cerr << "[ERROR] Variable " << original_vid << " in " << filename
+                  << " has a value out of its domain: "
+                  << (dense_free == Variable::INVALID_VALUE ? value_free
+                                                            : value_evid)
+                  << std::endl;
+        std::abort();
+      }
+      // seed the chains, except for evidence held at its value
+      assignments_free[vid] = dense_free;
+      if (!variable.is_evid || opts.should_sample_evidence)
+        assignments_evid[vid] = dense_evid;
+    }
+  });
+}
+
 void FactorGraph::load_variables(const std::vector<std::string> &filenames) {
   std::mutex mtx;
   parallel_load(filenames, [this, &mtx](const std::string &filename) {
@@ -0,0 +1,192 @@
+#include "bitsliced_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+namespace dd {
+
+// To placate linker error "undefined reference" (see variable.cc)
+constexpr size_t BitslicedSampler::NUM_CHAINS;
+
+static constexpr uint64_t ALL_CHAINS = ~(uint64_t)0;
+
+// xorshift64* generator, much cheaper than erand48 for 64 draws per variable
+static inline uint64_t next_random(uint64_t &state) {
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+// uniform in [0, 1) from the top 53 bits
+static inline double next_uniform(uint64_t &state) {
+  return (next_random(state) >> 11) * (1.0 / (1ULL << 53));
+}
+
+// a nonzero random state
+static inline uint64_t new_random_state() {
+  uint64_t state = 0;
+  while (state == 0) state = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+  return state;
+}
+
+bool BitslicedSampler::can_sample(const FactorGraph &fg) {
+  for (size_t vid = 0; vid < fg.size.num_variables; ++vid)
+    if (!fg.variables[vid].is_boolean()) return false;
+  for (size_t factor_id = 0; factor_id < fg.size.num_factors; ++factor_id) {
+    switch (fg.factors[factor_id].func_id) {
+      case FUNC_AND:
+      case FUNC_ISTRUE:
+      case FUNC_OR:
+      case FUNC_EQUAL:
+      case FUNC_IMPLY_NATURAL:
+      case FUNC_IMPLY_MLN:
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+BitslicedSampler::BitslicedSampler(const FactorGraph &fg,
+                                   const InferenceResult &infrs,
+                                   bool should_sample_evidence)
+    : fg_(fg),
+      is_sampled_(fg.size.num_variables, false),
+      bits_(fg.size.num_variables, 0) {
+  uint64_t rand_state = new_random_state();
+  for (size_t vid = 0; vid < fg.size.num_variables; ++vid) {
+    const Variable &variable = fg.variables[vid];
+    is_sampled_[vid] = (should_sample_evidence || !variable.is_evid) &&
+                       infrs.agg_nsamples[vid] == 0;
+    if (is_sampled_[vid]) {
+      bits_[vid] = (next_random(rand_state) & ~(uint64_t)1) |
+                   (infrs.assignments_evid[vid] == 1 ? 1 : 0);
+    } else {
+      bits_[vid] = infrs.assignments_evid[vid] == 1 ? ALL_CHAINS : 0;
+    }
+  }
+}
+
+void BitslicedSampler::sample(InferenceResult &infrs, size_t n_epochs,
+                              size_t n_threads, bool should_tally) {
+  while (rand_states_.size() < n_threads)
+    rand_states_.push_back(new_random_state());
+  const size_t nvar = fg_.size.num_variables;
+  const size_t chunk = nvar / n_threads + 1;
+  for (size_t i_epoch = 0; i_epoch < n_epochs; ++i_epoch) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; ++t) {
+      threads.push_back(std::thread([this, &infrs, nvar, chunk, t,
+                                     should_tally]() {
+        sample_range(infrs, std::min(nvar, chunk * t),
+                     std::min(nvar, chunk * (t + 1)), rand_states_[t],
+                     should_tally);
+      }));
+    }
+    for (auto &t : threads) t.join();
+  }
+}
+
+void BitslicedSampler::sample_range(InferenceResult &infrs, size_t begin,
+                                    size_t end, uint64_t &rand_state,
+                                    bool should_tally) {
+  // log odds of each chain's variable being true given the rest
+  double deltas[NUM_CHAINS];
+  for (size_t vid = begin; vid < end; ++vid) {
+    if (!is_sampled_[vid]) continue;
+    const Variable &variable = fg_.variables[vid];
+    std::fill(deltas, deltas + NUM_CHAINS, 0.0);
+    const VariableToFactor &var_value = fg_.values[variable.var_val_base];
+    for (size_t i = 0; i < var_value.factor_index_length; ++i) {
+      const Factor &factor =
+          fg_.factors[fg_.factor_index[var_value.factor_index_base + i]];
+      add_potential_deltas(factor, vid, infrs.weight_values[factor.weight_id],
+                           deltas);
+    }
+
+    uint64_t sample = 0;
+    for (size_t c = 0; c < NUM_CHAINS; ++c) {
+      if (next_uniform(rand_state) * (1.0 + exp(-deltas[c])) < 1.0)
+        sample |= (uint64_t)1 << c;
+    }
+    bits_[vid] = sample;
+    if (!should_tally) continue;
+
+    // bookkeep aggregates for computing marginals
+    infrs.agg_nsamples[vid] += NUM_CHAINS;
+    infrs.sample_tallies[variable.var_val_base] += __builtin_popcountll(sample);
+  }
+}
+
+inline void BitslicedSampler::add_potential_deltas(const Factor &factor,
+                                                   size_t vid, double weight,
+                                                   double deltas[]) const {
+  // chains where the factor is 1 and -1 (and 0 elsewhere), with the variable
+  // false and true
+  uint64_t pos[2], neg[2];
+  for (size_t value = 0; value < 2; ++value) {
+    uint64_t all = ALL_CHAINS, any = 0, equal = ALL_CHAINS, first = 0;
+    uint64_t body = ALL_CHAINS, head = 0;
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const FactorToVariable &vif = fg_.get_factor_vif_at(factor, j);
+      const uint64_t bits =
+          vif.vid == vid ? (value == 1 ? ALL_CHAINS : 0) : bits_[vif.vid];
+      const uint64_t satisfied = vif.dense_equal_to == 1 ? bits : ~bits;
+      if (j == 0) first = satisfied;
+      all &= satisfied;
+      any |= satisfied;
+      equal &= ~(satisfied ^ first);
+      if (j + 1 < factor.num_vars)
+        body &= satisfied;
+      else
+        head = satisfied;
+    }
+    switch (factor.func_id) {
+      case FUNC_AND:
+      case FUNC_ISTRUE:
+        pos[value] = all;
+        neg[value] = ~all;
+        break;
+      case FUNC_OR:
+        pos[value] = any;
+        neg[value] = ~any;
+        break;
+      case FUNC_EQUAL:
+        pos[value] = equal;
+        neg[value] = ~equal;
+        break;
+      case FUNC_IMPLY_NATURAL:
+        pos[value] = body & head;
+        neg[value] = body & ~head;
+        break;
+      case FUNC_IMPLY_MLN:
+        pos[value] = ~body | head;
+        neg[value] = 0;
+        break;
+      default:
+        std::cout << "Unsupported FACTOR_FUNCTION_TYPE = " << factor.func_id
+                  << std::endl;
+        std::abort();
+    }
+  }
+  // skip if the variable does not matter to the factor in any chain
+  if (pos[0] == pos[1] && neg[0] == neg[1]) return;
+
+  weight *= factor.feature_value;
+  for (size_t c = 0; c < NUM_CHAINS; ++c) {
+    int diff = (int)((pos[1] >> c) & 1) - (int)((neg[1] >> c) & 1) -
+               (int)((pos[0] >> c) & 1) + (int)((neg[0] >> c) & 1);
+    deltas[c] += weight * diff;
+  }
+}
+
+void BitslicedSampler::store_chain(InferenceResult &infrs) const {
+  for (size_t vid = 0; vid < fg_.size.num_variables; ++vid)
+    if (is_sampled_[vid]) infrs.assignments_evid[vid] = bits_[vid] & 1;
+}
+
+}  // namespace dd
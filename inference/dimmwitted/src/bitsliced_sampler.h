@@ -0,0 +1,78 @@
+#ifndef DIMMWITTED_BITSLICED_SAMPLER_H_
+#define DIMMWITTED_BITSLICED_SAMPLER_H_
+
+#include "factor_graph.h"
+#include "inference_result.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace dd {
+
+/**
+ * Gibbs sampler running 64 chains at once over a factor graph of boolean
+ * variables with only logical factors (AND, ISTRUE, OR, EQUAL, and both
+ * IMPLY's), for many more samples per epoch than one chain per copy.
+ *
+ * Each variable keeps one bit per chain in a single word, so a factor is
+ * evaluated for all chains by bitwise operations on the words of its
+ * variables, and the index of the factors of a variable is traversed once
+ * for all 64 samples drawn for it.  The marginals are tallied by counting
+ * the bits set.
+ */
+class BitslicedSampler {
+ public:
+  // number of chains, i.e., bits in a word
+  static constexpr size_t NUM_CHAINS = 64;
+
+  /**
+   * Returns whether the given factor graph only has variables and factors
+   * this can sample.
+   */
+  static bool can_sample(const FactorGraph &fg);
+
+  /**
+   * Prepares the chains for the given (indexed) factor graph, with the
+   * evidence clamped to its values unless should_sample_evidence, starting
+   * the first one from the evid chain of infrs and the others from random
+   * values.  Query variables whose marginals are already computed (i.e., with
+   * samples tallied in infrs) are left out, as nothing else depends on them.
+   */
+  BitslicedSampler(const FactorGraph &fg, const InferenceResult &infrs,
+                   bool should_sample_evidence);
+
+  /**
+   * Samples all chains for n_epochs epochs using n_threads threads, and
+   * tallies the samples into infrs if should_tally.
+   */
+  void sample(InferenceResult &infrs, size_t n_epochs, size_t n_threads,
+              bool should_tally = true);
+
+  /**
+   * Copies the values of the first chain to the evid chain of infrs, e.g.,
+   * for dumping the chains.
+   */
+  void store_chain(InferenceResult &infrs) const;
+
+ private:
+  const FactorGraph &fg_;
+  std::vector<bool> is_sampled_;
+  // values of each variable, the i-th bit for the i-th chain
+  std::vector<uint64_t> bits_;
+  // random state of each thread
+  std::vector<uint64_t> rand_states_;
+
+  // samples the variables [begin, end) in all chains with the given random
+  // state
+  void sample_range(InferenceResult &infrs, size_t begin, size_t end,
+                    uint64_t &rand_state, bool should_tally);
+
+  // adds the weighted difference between the potentials of the factor with
+  // the given variable true and false in each chain to deltas
+  inline void add_potential_deltas(const Factor &factor, size_t vid,
+                                   double weight, double deltas[]) const;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_BITSLICED_SAMPLER_H_
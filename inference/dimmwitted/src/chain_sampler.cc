@@ -0,0 +1,244 @@
+#include "chain_sampler.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dd {
+
+// ids of the factors adjacent to the given variable, each once
+static void get_factors_of(const FactorGraph &fg, const Variable &variable,
+                           std::vector<size_t> &factor_ids) {
+  factor_ids.clear();
+  for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+    const VariableToFactor &var_value = fg.values[variable.var_val_base + k];
+    factor_ids.insert(factor_ids.end(),
+                      &fg.factor_index[var_value.factor_index_base],
+                      &fg.factor_index[var_value.factor_index_base +
+                                       var_value.factor_index_length]);
+  }
+  std::sort(factor_ids.begin(), factor_ids.end());
+  factor_ids.erase(std::unique(factor_ids.begin(), factor_ids.end()),
+                   factor_ids.end());
+}
+
+ChainSampler::ChainSampler(const FactorGraph &fg, std::vector<size_t> &vids)
+    : bases_(1, 0), unary_bases_(1, 0), pair_bases_(1, 0) {
+  const size_t nvar = fg.size.num_variables;
+  std::vector<bool> is_candidate(nvar, false);
+  for (size_t vid : vids)
+    if (!fg.variables[vid].is_evid) is_candidate[vid] = true;
+
+  // link the candidates sharing a factor, where a candidate can be in a chain
+  // only if it has at most two such neighbors and no factor with two others
+  std::vector<size_t> neighbors(2 * nvar);
+  std::vector<size_t> degree(nvar, 0);
+  std::vector<bool> is_branching(nvar, false);
+  std::vector<size_t> factor_ids;
+  for (size_t vid : vids) {
+    if (!is_candidate[vid]) continue;
+    get_factors_of(fg, fg.variables[vid], factor_ids);
+    for (size_t factor_id : factor_ids) {
+      const Factor &factor = fg.factors[factor_id];
+      size_t num_candidates = 0;
+      size_t other = Variable::INVALID_ID;
+      for (size_t j = 0; j < factor.num_vars; ++j) {
+        size_t neighbor = fg.get_factor_vif_at(factor, j).vid;
+        if (!is_candidate[neighbor]) continue;
+        ++num_candidates;
+        if (neighbor != vid) other = neighbor;
+      }
+      if (num_candidates > 2) is_branching[vid] = true;
+      if (num_candidates != 2 || other == Variable::INVALID_ID) continue;
+      size_t *begin = &neighbors[2 * vid];
+      if (std::find(begin, begin + degree[vid], other) != begin + degree[vid])
+        continue;
+      if (degree[vid] == 2)
+        is_branching[vid] = true;
+      else
+        begin[degree[vid]++] = other;
+    }
+  }
+
+  // take every group of linked candidates that forms a simple path
+  std::vector<bool> is_visited(nvar, false);
+  std::vector<bool> is_chained(nvar, false);
+  std::vector<size_t> group;
+  for (size_t vid : vids) {
+    if (!is_candidate[vid] || is_visited[vid]) continue;
+    group.assign(1, vid);
+    is_visited[vid] = true;
+    bool is_path = true;
+    size_t num_links = 0;
+    for (size_t i = 0; i < group.size(); ++i) {
+      size_t member = group[i];
+      if (is_branching[member]) is_path = false;
+      num_links += degree[member];
+      for (size_t j = 0; j < degree[member]; ++j) {
+        size_t neighbor = neighbors[2 * member + j];
+        if (is_visited[neighbor]) continue;
+        is_visited[neighbor] = true;
+        group.push_back(neighbor);
+      }
+    }
+    // a connected group with one link less than members has no cycle
+    if (!is_path || group.size() < 2 || num_links / 2 != group.size() - 1)
+      continue;
+
+    // walk from the end with the smallest id
+    size_t prev = Variable::INVALID_ID;
+    size_t cur = Variable::INVALID_ID;
+    for (size_t member : group)
+      if (degree[member] == 1 && member < cur) cur = member;
+    while (cur != Variable::INVALID_ID) {
+      vids_.push_back(cur);
+      is_chained[cur] = true;
+      size_t next = Variable::INVALID_ID;
+      for (size_t j = 0; j < degree[cur]; ++j)
+        if (neighbors[2 * cur + j] != prev) next = neighbors[2 * cur + j];
+      prev = cur;
+      cur = next;
+    }
+    bases_.push_back(vids_.size());
+  }
+
+  // split the factors of each variable into those of its own and those
+  // shared with the next one in its chain
+  for (size_t chain = 0; chain < num_chains(); ++chain) {
+    for (size_t p = bases_[chain]; p < bases_[chain + 1]; ++p) {
+      size_t vid = vids_[p];
+      size_t next =
+          p + 1 < bases_[chain + 1] ? vids_[p + 1] : Variable::INVALID_ID;
+      get_factors_of(fg, fg.variables[vid], factor_ids);
+      for (size_t factor_id : factor_ids) {
+        const Factor &factor = fg.factors[factor_id];
+        bool is_unary = true;
+        bool has_next = false;
+        for (size_t j = 0; j < factor.num_vars; ++j) {
+          size_t neighbor = fg.get_factor_vif_at(factor, j).vid;
+          if (neighbor != vid && is_candidate[neighbor]) is_unary = false;
+          if (neighbor == next) has_next = true;
+        }
+        if (is_unary)
+          unary_factor_ids_.push_back(factor_id);
+        else if (has_next)
+          pair_factor_ids_.push_back(factor_id);
+      }
+      unary_bases_.push_back(unary_factor_ids_.size());
+      pair_bases_.push_back(pair_factor_ids_.size());
+    }
+  }
+
+  vids.erase(std::remove_if(vids.begin(), vids.end(),
+                            [&is_chained](size_t vid) {
+                              return is_chained[vid];
+                            }),
+             vids.end());
+}
+
+inline double ChainSampler::unary_potential(FactorGraph &fg,
+                                            InferenceResult &infrs, size_t p,
+                                            size_t value) const {
+  double pot = 0;
+  for (size_t i = unary_bases_[p]; i < unary_bases_[p + 1]; ++i) {
+    const Factor &factor = fg.factors[unary_factor_ids_[i]];
+    pot += infrs.weight_values[factor.weight_id] *
+           factor.potential(fg.vifs.get(), infrs.assignments_evid.get(),
+                            vids_[p], value);
+  }
+  return pot;
+}
+
+inline double ChainSampler::pair_potential(FactorGraph &fg,
+                                           InferenceResult &infrs, size_t p,
+                                           size_t value,
+                                           size_t next_value) const {
+  infrs.assignments_evid[vids_[p]] = value;
+  double pot = 0;
+  for (size_t i = pair_bases_[p]; i < pair_bases_[p + 1]; ++i) {
+    const Factor &factor = fg.factors[pair_factor_ids_[i]];
+    pot += infrs.weight_values[factor.weight_id] *
+           factor.potential(fg.vifs.get(), infrs.assignments_evid.get(),
+                            vids_[p + 1], next_value);
+  }
+  return pot;
+}
+
+void ChainSampler::sample(size_t chain, FactorGraph &fg, InferenceResult &infrs,
+                          unsigned short rand_seed[3], bool should_tally,
+                          std::vector<double> &buffer,
+                          double inverse_temperature) const {
+  const size_t begin = bases_[chain];
+  const size_t end = bases_[chain + 1];
+  size_t num_values = 0;
+  for (size_t p = begin; p < end; ++p)
+    num_values += fg.variables[vids_[p]].cardinality;
+  buffer.resize(num_values);
+
+  // forward filtering: the log potential of each value of each variable,
+  // summed over the values of the ones before it
+  size_t offset = 0;
+  size_t prev_offset = 0;
+  size_t prev_cardinality = 0;
+  for (size_t p = begin; p < end; ++p) {
+    const size_t cardinality = fg.variables[vids_[p]].cardinality;
+    for (size_t value = 0; value < cardinality; ++value) {
+      double alpha =
+          inverse_temperature * unary_potential(fg, infrs, p, value);
+      if (p > begin) {
+        // log-sum-exp over the values of the previous variable, starting from
+        // the first term rather than a floor that would add mass of its own
+        double message = 0;
+        for (size_t prev = 0; prev < prev_cardinality; ++prev) {
+          double term = buffer[prev_offset + prev] +
+                        inverse_temperature *
+                            pair_potential(fg, infrs, p - 1, prev, value);
+          message = prev == 0 ? term : logadd(message, term);
+        }
+        alpha += message;
+      }
+      buffer[offset + value] = alpha;
+    }
+    prev_offset = offset;
+    prev_cardinality = cardinality;
+    offset += cardinality;
+  }
+
+  // backward sampling: each variable given the one sampled after it
+  size_t next_value = Variable::INVALID_VALUE;
+  for (size_t p = end; p-- > begin;) {
+    const Variable &variable = fg.variables[vids_[p]];
+    offset -= variable.cardinality;
+    double *log_probs = &buffer[offset];
+    for (size_t value = 0; value < variable.cardinality; ++value) {
+      if (p + 1 < end) {
+        log_probs[value] += inverse_temperature *
+                            pair_potential(fg, infrs, p, value, next_value);
+      }
+    }
+    double sum = log_probs[0];
+    for (size_t value = 1; value < variable.cardinality; ++value)
+      sum = logadd(sum, log_probs[value]);
+    size_t proposal = variable.cardinality - 1;
+    double r = erand48(rand_seed);
+    for (size_t value = 0; value + 1 < variable.cardinality; ++value) {
+      r -= exp(log_probs[value] - sum);
+      if (r <= 0) {
+        proposal = value;
+        break;
+      }
+    }
+    infrs.assignments_evid[variable.id] = proposal;
+    next_value = proposal;
+    if (!should_tally) continue;
+
+    // bookkeep aggregates for computing marginals
+    ++infrs.agg_nsamples[variable.id];
+    if (!variable.is_boolean() || proposal == 1) {
+      ++infrs.sample_tallies[variable.var_val_base +
+                             variable.var_value_offset(proposal)];
+    }
+  }
+}
+
+}  // namespace dd
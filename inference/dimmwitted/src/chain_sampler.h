@@ -0,0 +1,74 @@
+#ifndef DIMMWITTED_CHAIN_SAMPLER_H_
+#define DIMMWITTED_CHAIN_SAMPLER_H_
+
+#include "factor_graph.h"
+#include "inference_result.h"
+
+#include <vector>
+
+namespace dd {
+
+/**
+ * Blocked sampler for chain-structured parts of a factor graph, e.g., the
+ * linear-chain CRFs of sequence labeling, whose variables are each resampled
+ * jointly by forward filtering and backward sampling (FFBS), instead of one at
+ * a time, which mixes poorly under strong pairwise couplings.
+ *
+ * A chain is a path of two or more query variables where every factor touches
+ * at most two of them, and only neighbors on the path share factors, given
+ * the evidence stays fixed.
+ */
+class ChainSampler {
+ public:
+  /**
+   * Finds the chains among the given variables to sample, and removes the
+   * variables of the chains from vids.
+   */
+  ChainSampler(const FactorGraph &fg, std::vector<size_t> &vids);
+
+  inline size_t num_chains() const { return bases_.size() - 1; }
+
+  inline size_t size_of(size_t chain) const {
+    return bases_[chain + 1] - bases_[chain];
+  }
+
+  /**
+   * Jointly samples the variables of the given chain in infrs' evid chain
+   * from their distribution given the rest, and tallies the sample for the
+   * marginals if should_tally, with the potentials scaled by the given
+   * inverse temperature.
+   * fg must have the same structure as the one given to the constructor,
+   * e.g., a copy on another NUMA node, and buffer is for scratch space.
+   */
+  void sample(size_t chain, FactorGraph &fg, InferenceResult &infrs,
+              unsigned short rand_seed[3], bool should_tally,
+              std::vector<double> &buffer,
+              double inverse_temperature = 1) const;
+
+ private:
+  // variables of each chain in path order, where the ones of the i-th are at
+  // [bases_[i], bases_[i + 1])
+  std::vector<size_t> vids_;
+  std::vector<size_t> bases_;
+  // factors touching no other variable of the chain than the one at each
+  // position p, at [unary_bases_[p], unary_bases_[p + 1])
+  std::vector<size_t> unary_factor_ids_;
+  std::vector<size_t> unary_bases_;
+  // factors between the variables at positions p and p + 1, at
+  // [pair_bases_[p], pair_bases_[p + 1])
+  std::vector<size_t> pair_factor_ids_;
+  std::vector<size_t> pair_bases_;
+
+  // log potential of the factors of the variable at position p alone, and
+  // of those between it and the next, with the variables taking the given
+  // values (which are left in the evid chain)
+  inline double unary_potential(FactorGraph &fg, InferenceResult &infrs,
+                                size_t p, size_t value) const;
+  inline double pair_potential(FactorGraph &fg, InferenceResult &infrs,
+                               size_t p, size_t value,
+                               size_t next_value) const;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_CHAIN_SAMPLER_H_
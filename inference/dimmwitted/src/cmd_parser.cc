@@ -53,8 +53,8 @@ CmdParser::CmdParser(
   // for TCLAP, see:
   // http://tclap.sourceforge.net/manual.html#FUNDAMENTAL_CLASSES
 
-  if (app_name == "gibbs") {
-    TCLAP::CmdLine cmd_("DimmWitted gibbs", ' ', DimmWittedVersion);
+  if (app_name == "gibbs" || app_name == "map" || app_name == "sweep") {
+    TCLAP::CmdLine cmd_("DimmWitted " + app_name, ' ', DimmWittedVersion);
 
     TCLAP::ValueArg<std::string> fg_file_("m", "fg_meta",
                                           "factor graph metadata file", false,
@@ -68,6 +68,16 @@ CmdParser::CmdParser(
                                               false, "string", cmd_);
     TCLAP::MultiArg<std::string> weight_file_("w", "weights", "weights file",
                                               false, "string", cmd_);
+    TCLAP::MultiArg<std::string> init_chains_file_(
+        "", "init_chains",
+        "binary chains file, e.g., inference_result.out.chains.bin of a "
+        "previous run, to start sampling from instead of all zeros",
+        false, "string", cmd_);
+    TCLAP::MultiArg<std::string> learned_weight_file_(
+        "", "learned_weights",
+        "binary weights file, e.g., inference_result.out.weights.bin of a "
+        "previous run, whose values override the initial ones",
+        false, "string", cmd_);
 
     TCLAP::ValueArg<std::string> output_folder_(
         "o", "outputFile", "Output Folder", false, "", "string", cmd_);
@@ -75,11 +85,70 @@ CmdParser::CmdParser(
     TCLAP::MultiArg<size_t> n_learning_epoch_("l", "n_learning_epoch",
                                               "Number of Learning Epochs", true,
                                               "int", cmd_);
+    TCLAP::MultiArg<size_t> n_pl_epoch_(
+        "", "n_pl_epoch",
+        "Number of pseudo-likelihood learning epochs to run before the "
+        "contrastive learning epochs",
+        false, "int", cmd_);
     TCLAP::MultiArg<size_t> n_inference_epoch_(
         "i", "n_inference_epoch", "Number of Samples for Inference", true,
         "int", cmd_);
-    TCLAP::MultiArg<size_t> burn_in_("", "burn_in", "Burn-in period", false,
-                                     "int", cmd_);
+    TCLAP::MultiArg<size_t> burn_in_(
+        "", "burn_in",
+        "Number of inference epochs to sample before the ones tallied for "
+        "the marginals (default: 0)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<double> map_temperature_(
+        "", "map_temperature",
+        "Temperature to start annealing from in map mode, cooling down to 0 "
+        "over n_inference_epoch epochs (default: 1; 0 for just iterated "
+        "conditional modes)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<size_t> mean_field_init_(
+        "", "mean_field_init",
+        "Start the inference chains from values drawn from a mean-field "
+        "approximation updated for up to this many iterations (default: 0, "
+        "i.e., from all zeros or the chains left by learning)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<double> parallel_tempering_(
+        "", "parallel_tempering",
+        "Run the factor graph copies at temperatures from 1 up to this in "
+        "inference, swapping their chains every tempering_interval epochs, "
+        "and tally only the copy at temperature 1 (default: 0, i.e., off)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<size_t> tempering_interval_(
+        "", "tempering_interval",
+        "Number of inference epochs between attempts to swap the chains of "
+        "copies at neighboring temperatures (default: 1)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<double> adaptive_scan_(
+        "", "adaptive_scan",
+        "Visit each variable in an inference epoch in proportion to how often "
+        "its value flips, but at least at this rate (e.g., 0.1) relative to "
+        "the average, instead of exactly once (default: 0, i.e., off)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<double> inference_rhat_(
+        "", "inference_rhat",
+        "Stop inference early once the Gelman-Rubin R-hat of every marginal "
+        "across the factor graph copies is below this (e.g., 1.01; default: "
+        "0, i.e., never)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<double> inference_delta_(
+        "", "inference_delta",
+        "Stop inference early once no marginal changes more than this "
+        "between convergence checks (default: 0, i.e., never)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<size_t> exact_component_states_(
+        "", "exact_component_states",
+        "Compute the marginals of connected components exactly instead of "
+        "sampling when their query variables have at most this many joint "
+        "assignments, e.g., 4096 (default: 0, i.e., always sample)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<size_t> convergence_interval_(
+        "", "convergence_interval",
+        "Number of inference epochs between convergence checks for "
+        "--inference_rhat or --inference_delta (default: 10)",
+        false, "int", cmd_);
     TCLAP::MultiArg<size_t> n_datacopy_(
         "c", "n_datacopy",
         "Number of factor graph copies. Use 0 for all "
@@ -100,6 +169,54 @@ CmdParser::CmdParser(
     TCLAP::MultiArg<std::string> regularization_("", "regularization",
                                                  "Regularization (l1 or l2)",
                                                  false, "string", cmd_);
+    TCLAP::MultiArg<double> holdout_fraction_(
+        "", "holdout_fraction",
+        "Fraction of evidence to hold out in sweep mode for comparing the "
+        "weights learned with every combination of the alpha, diminish, and "
+        "reg_param values given (default: 0.1)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<std::string> engine_(
+        "", "engine",
+        "How inference estimates the marginals: by Gibbs sampling (gibbs) or "
+        "by loopy belief propagation for up to n_inference_epoch iterations "
+        "(bp)",
+        false, "string", cmd_);
+    TCLAP::MultiArg<double> bp_damping_(
+        "", "bp_damping",
+        "Fraction of the previous message kept in each belief propagation "
+        "update (default: 0.5)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<std::string> learning_sweep_(
+        "", "learning_sweep",
+        "How each learning epoch computes gradients: per variable (variable) "
+        "or once per factor after sampling all variables (factor)",
+        false, "string", cmd_);
+    TCLAP::MultiArg<double> learning_fraction_(
+        "", "learning_fraction",
+        "Fraction of variables to visit in each learning epoch (default: 1)",
+        false, "double", cmd_);
+    TCLAP::MultiArg<std::string> shared_weights_(
+        "", "shared_weights",
+        "Name of a POSIX shared memory object for merging weights with "
+        "other processes learning concurrently, e.g., on other partitions",
+        false, "string", cmd_);
+    TCLAP::MultiArg<size_t> shared_weights_rank_(
+        "", "shared_weights_rank",
+        "Rank of this process among those sharing weights (0 creates the "
+        "shared memory)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<size_t> shared_weights_nprocs_(
+        "", "shared_weights_nprocs", "Number of processes sharing weights",
+        false, "int", cmd_);
+    TCLAP::MultiArg<size_t> shared_weights_sync_(
+        "", "shared_weights_sync",
+        "Number of learning epochs between weight merging (default: 1)",
+        false, "int", cmd_);
+    TCLAP::MultiArg<size_t> checkpoint_interval_(
+        "", "checkpoint_interval",
+        "Number of learning or inference epochs between checkpoints written "
+        "to the output folder (default: 0, i.e., never)",
+        false, "int", cmd_);
 
     TCLAP::MultiSwitchArg quiet_("q", "quiet", "quiet output", cmd_);
     TCLAP::MultiSwitchArg sample_evidence_(
@@ -108,6 +225,77 @@ CmdParser::CmdParser(
     TCLAP::MultiSwitchArg learn_non_evidence_(
         "", "learn_non_evidence", "sample non-evidence variables in learning",
         cmd_);
+    TCLAP::MultiSwitchArg stratify_evidence_(
+        "", "stratify_evidence",
+        "subsample evidence and non-evidence variables separately when "
+        "learning_fraction is less than 1",
+        cmd_);
+    TCLAP::MultiSwitchArg resume_(
+        "", "resume",
+        "resume learning or inference from the checkpoint in the output "
+        "folder if there is one",
+        cmd_);
+    TCLAP::MultiSwitchArg rao_blackwell_(
+        "", "rao_blackwell",
+        "estimate marginals by averaging the conditional distributions the "
+        "samples are drawn from rather than the samples themselves",
+        cmd_);
+    TCLAP::MultiSwitchArg dump_chains_(
+        "", "dump_chains",
+        "write the final state of the chains to "
+        "inference_result.out.chains.bin in the output folder, e.g., for "
+        "--init_chains of a later run",
+        cmd_);
+    TCLAP::MultiSwitchArg dump_components_(
+        "", "dump_components",
+        "write the connected components with query variables to "
+        "mat_components_hasevids and mat_active_components in the output "
+        "folder",
+        cmd_);
+    TCLAP::MultiSwitchArg block_chains_(
+        "", "block_chains",
+        "sample chain-structured query variables jointly by forward filtering "
+        "and backward sampling in inference",
+        cmd_);
+    TCLAP::MultiSwitchArg bitslice_(
+        "", "bitslice",
+        "sample 64 chains at once in inference with one bit of a word per "
+        "chain for each variable, if all variables are boolean and all "
+        "factors are logical ones",
+        cmd_);
+    TCLAP::MultiSwitchArg dedup_factors_(
+        "", "dedup_factors",
+        "merge factors with the same function, variables, and weight into one "
+        "with the sum of their feature values when loading",
+        cmd_);
+    TCLAP::MultiSwitchArg reorder_(
+        "", "reorder",
+        "renumber the variables and factors in breadth-first order when "
+        "loading, so neighbors sit close together in memory, still writing "
+        "the original variable ids",
+        cmd_);
+    TCLAP::MultiSwitchArg force_gibbs_(
+        "", "force_gibbs",
+        "always use Gibbs sampling even when learning or inference can be "
+        "done exactly, e.g., when all factors are unary",
+        cmd_);
+    TCLAP::MultiSwitchArg sample_observed_(
+        "", "sample_observed",
+        "sample query variables whose neighbors are all evidence in inference "
+        "too; by default their marginals are computed exactly once instead",
+        cmd_);
+    TCLAP::MultiSwitchArg keep_evidence_factors_(
+        "", "keep_evidence_factors",
+        "sample with the factors as loaded in inference; by default, factors "
+        "are specialized to the evidence first, which keeps the conditionals "
+        "up to rounding but may change individual samples",
+        cmd_);
+    TCLAP::MultiSwitchArg keep_unary_factors_(
+        "", "keep_unary_factors",
+        "evaluate unary factors one by one in inference; by default, they are "
+        "summed into per-value biases first, which keeps the conditionals up "
+        "to rounding but may change individual samples",
+        cmd_);
     TCLAP::MultiSwitchArg noise_aware_(
         "", "noise_aware",
         "learn using noisy/soft evidence instead of hard evidence", cmd_);
@@ -118,10 +306,14 @@ CmdParser::CmdParser(
     variable_file = variable_file_.getValue();
     factor_file = factor_file_.getValue();
     weight_file = weight_file_.getValue();
+    learned_weight_file = learned_weight_file_.getValue();
+    init_chains_file = init_chains_file_.getValue();
     output_folder = output_folder_.getValue();
+    checkpoint_file = output_folder + "/inference_result.checkpoint";
     domain_file = domain_file_.getValue();
 
     n_learning_epoch = getLastValueOrDefault(n_learning_epoch_, (size_t)0);
+    n_pl_epoch = getLastValueOrDefault(n_pl_epoch_, (size_t)0);
     n_inference_epoch = getLastValueOrDefault(n_inference_epoch_, (size_t)0);
 
     n_datacopy = getLastValueOrDefault(n_datacopy_, (size_t)0);
@@ -153,6 +345,39 @@ CmdParser::CmdParser(
         << n_datacopy << ") or some CPU cores will stay idle" << std::endl;
 
     burn_in = getLastValueOrDefault(burn_in_, (size_t)0);
+    map_temperature = getLastValueOrDefault(map_temperature_, 1.0);
+    check(map_temperature >= 0)
+        << "map_temperature (" << map_temperature << ") must not be negative"
+        << std::endl;
+    mean_field_iterations =
+        getLastValueOrDefault(mean_field_init_, (size_t)0);
+    exact_component_states =
+        getLastValueOrDefault(exact_component_states_, (size_t)0);
+    inference_rhat = getLastValueOrDefault(inference_rhat_, 0.0);
+    inference_delta = getLastValueOrDefault(inference_delta_, 0.0);
+    convergence_interval =
+        getLastValueOrDefault(convergence_interval_, (size_t)10);
+    check(convergence_interval > 0)
+        << "convergence_interval must be positive" << std::endl;
+    max_temperature = getLastValueOrDefault(parallel_tempering_, 0.0);
+    tempering_interval =
+        getLastValueOrDefault(tempering_interval_, (size_t)1);
+    check(max_temperature == 0 || max_temperature > 1)
+        << "parallel_tempering (" << max_temperature
+        << ") must be greater than 1" << std::endl;
+    check(tempering_interval > 0)
+        << "tempering_interval must be positive" << std::endl;
+    recommend(max_temperature == 0 || n_datacopy > 1)
+        << "parallel_tempering needs n_datacopy > 1 to run copies at "
+           "different temperatures, so it is ignored" << std::endl;
+    if (n_datacopy < 2) max_temperature = 0;
+    min_scan_rate = getLastValueOrDefault(adaptive_scan_, 0.0);
+    check(min_scan_rate >= 0 && min_scan_rate <= 1)
+        << "adaptive_scan (" << min_scan_rate << ") must be between 0 and 1"
+        << std::endl;
+    recommend(inference_rhat == 0 || n_datacopy > 1)
+        << "inference_rhat needs n_datacopy > 1 to compare chains, so "
+           "it is ignored" << std::endl;
     stepsize = getLastValueOrDefault(stepsize_, 0.01);
     stepsize2 = getLastValueOrDefault(stepsize2_, 0.01);
     if (stepsize == 0.01)
@@ -160,15 +385,78 @@ CmdParser::CmdParser(
           stepsize2;  // XXX hack to support two parameters to specify step size
     decay = getLastValueOrDefault(decay_, 0.95);
     reg_param = getLastValueOrDefault(reg_param_, 0.01);
+    sweep_stepsizes = stepsize_.getValue();
+    if (sweep_stepsizes.empty()) sweep_stepsizes.push_back(stepsize);
+    sweep_decays = decay_.getValue();
+    if (sweep_decays.empty()) sweep_decays.push_back(decay);
+    sweep_reg_params = reg_param_.getValue();
+    if (sweep_reg_params.empty()) sweep_reg_params.push_back(reg_param);
+    holdout_fraction = getLastValueOrDefault(holdout_fraction_, 0.1);
+    check(holdout_fraction > 0 && holdout_fraction < 1)
+        << "holdout_fraction (" << holdout_fraction
+        << ") must be between 0 and 1" << std::endl;
     regularization =
         getLastValueOrDefault(regularization_, std::string("l2")) == "l1"
             ? REG_L1
             : REG_L2;
+    std::string sweep =
+        getLastValueOrDefault(learning_sweep_, std::string("variable"));
+    check(sweep == "variable" || sweep == "factor")
+        << "learning_sweep (" << sweep << ") must be either variable or factor"
+        << std::endl;
+    learning_sweep = sweep == "factor" ? SWEEP_FACTOR : SWEEP_VARIABLE;
+    std::string engine = getLastValueOrDefault(engine_, std::string("gibbs"));
+    check(engine == "gibbs" || engine == "bp")
+        << "engine (" << engine << ") must be either gibbs or bp" << std::endl;
+    inference_engine = engine == "bp" ? ENGINE_BP : ENGINE_GIBBS;
+    bp_damping = getLastValueOrDefault(bp_damping_, 0.5);
+    check(0 <= bp_damping && bp_damping < 1)
+        << "bp_damping (" << bp_damping << ") must be in the range of [0, 1)"
+        << std::endl;
+    learning_fraction = getLastValueOrDefault(learning_fraction_, 1.0);
+    check(0 < learning_fraction && learning_fraction <= 1)
+        << "learning_fraction (" << learning_fraction
+        << ") must be in the range of (0, 1]" << std::endl;
+
+    shared_weights = getLastValueOrDefault(shared_weights_, std::string());
+    shared_weights_rank =
+        getLastValueOrDefault(shared_weights_rank_, (size_t)0);
+    shared_weights_nprocs =
+        getLastValueOrDefault(shared_weights_nprocs_, (size_t)1);
+    shared_weights_sync =
+        getLastValueOrDefault(shared_weights_sync_, (size_t)1);
+    if (!shared_weights.empty()) {
+      check(shared_weights_rank < shared_weights_nprocs)
+          << "shared_weights_rank (" << shared_weights_rank
+          << ") must be less than shared_weights_nprocs ("
+          << shared_weights_nprocs << ")" << std::endl;
+      check(shared_weights_sync > 0)
+          << "shared_weights_sync must be positive" << std::endl;
+    }
+    checkpoint_interval =
+        getLastValueOrDefault(checkpoint_interval_, (size_t)0);
 
     should_be_quiet = quiet_.getValue() > 0;
     should_sample_evidence = sample_evidence_.getValue() > 0;
     should_learn_non_evidence = learn_non_evidence_.getValue() > 0;
+    should_stratify_evidence = stratify_evidence_.getValue() > 0;
+    should_resume = resume_.getValue() > 0;
+    should_force_gibbs = force_gibbs_.getValue() > 0;
+    should_sample_observed = sample_observed_.getValue() > 0;
+    should_keep_evidence_factors = keep_evidence_factors_.getValue() > 0;
+    should_keep_unary_factors = keep_unary_factors_.getValue() > 0;
+    should_rao_blackwellize = rao_blackwell_.getValue() > 0;
+    should_dump_components = dump_components_.getValue() > 0;
+    should_dump_chains = dump_chains_.getValue() > 0;
+    should_block_chains = block_chains_.getValue() > 0;
+    should_bitslice = bitslice_.getValue() > 0;
+    should_dedup_factors = dedup_factors_.getValue() > 0;
+    should_reorder = reorder_.getValue() > 0;
     is_noise_aware = noise_aware_.getValue() > 0;
+    check(!is_noise_aware || learning_sweep != SWEEP_FACTOR)
+        << "noise_aware is not supported with learning_sweep factor, which "
+           "does not weight the gradients by truthiness"
+        << std::endl;
 
   } else if (app_name == "text2bin") {
     TCLAP::CmdLine cmd_("DimmWitted text2bin", ' ', DimmWittedVersion);
@@ -274,19 +562,81 @@ std::ostream& operator<<(std::ostream& stream, const CmdParser& args) {
   stream << "# variable_file      : " << args.variable_file << std::endl;
   stream << "# domain_file        : " << args.domain_file << std::endl;
   stream << "# weight_file        : " << args.weight_file << std::endl;
+  stream << "# learned_weight_file: " << args.learned_weight_file << std::endl;
+  stream << "# init_chains_file   : " << args.init_chains_file << std::endl;
+  stream << "# dump_chains        : " << args.should_dump_chains << std::endl;
   stream << "# factor_file        : " << args.factor_file << std::endl;
   stream << "# output_folder      : " << args.output_folder << std::endl;
   stream << "# n_learning_epoch   : " << args.n_learning_epoch << std::endl;
+  stream << "# n_pl_epoch         : " << args.n_pl_epoch << std::endl;
   stream << "# n_inference_epoch  : " << args.n_inference_epoch << std::endl;
   stream << "# stepsize           : " << args.stepsize << std::endl;
   stream << "# decay              : " << args.decay << std::endl;
   stream << "# regularization     : " << args.reg_param << std::endl;
+  if (args.app_name == "sweep") {
+    stream << "# sweep_stepsizes    : " << args.sweep_stepsizes << std::endl;
+    stream << "# sweep_decays       : " << args.sweep_decays << std::endl;
+    stream << "# sweep_reg_params   : " << args.sweep_reg_params << std::endl;
+    stream << "# holdout_fraction   : " << args.holdout_fraction << std::endl;
+  }
+  stream << "# learning_sweep     : "
+         << (args.learning_sweep == SWEEP_FACTOR ? "factor" : "variable")
+         << std::endl;
+  stream << "# learning_fraction  : " << args.learning_fraction;
+  if (args.should_stratify_evidence) stream << " (stratified)";
+  stream << std::endl;
+  if (!args.shared_weights.empty()) {
+    stream << "# shared_weights     : " << args.shared_weights << " (rank "
+           << args.shared_weights_rank << " of "
+           << args.shared_weights_nprocs << ", every "
+           << args.shared_weights_sync << " epochs)" << std::endl;
+  }
+  stream << "# checkpoint_interval: " << args.checkpoint_interval
+         << (args.should_resume ? " (resume)" : "") << std::endl;
   stream << "# burn_in            : " << args.burn_in << std::endl;
+  if (args.app_name == "map") {
+    stream << "# map_temperature    : " << args.map_temperature << std::endl;
+  }
+  stream << "# mean_field_init    : " << args.mean_field_iterations
+         << std::endl;
+  stream << "# exact_comp_states  : " << args.exact_component_states
+         << std::endl;
+  if (args.inference_rhat > 0 || args.inference_delta > 0) {
+    stream << "# inference_rhat     : " << args.inference_rhat << std::endl;
+    stream << "# inference_delta    : " << args.inference_delta
+           << " (every " << args.convergence_interval << " epochs)"
+           << std::endl;
+  }
+  if (args.inference_engine == ENGINE_BP) {
+    stream << "# engine             : bp (damping " << args.bp_damping << ")"
+           << std::endl;
+  }
+  if (args.max_temperature > 0) {
+    stream << "# parallel_tempering : " << args.max_temperature << " (every "
+           << args.tempering_interval << " epochs)" << std::endl;
+  }
+  if (args.min_scan_rate > 0) {
+    stream << "# adaptive_scan      : " << args.min_scan_rate << std::endl;
+  }
   stream << "# n_datacopy         : " << args.n_datacopy << std::endl;
   stream << "# n_threads          : " << args.n_threads << std::endl;
   stream << "# learn_non_evidence : " << args.should_learn_non_evidence
          << std::endl;
   stream << "# is_noise_aware     : " << args.is_noise_aware << std::endl;
+  stream << "# force_gibbs        : " << args.should_force_gibbs << std::endl;
+  stream << "# sample_observed    : " << args.should_sample_observed
+         << std::endl;
+  stream << "# keep_evid_factors  : " << args.should_keep_evidence_factors
+         << std::endl;
+  stream << "# keep_unary_factors : " << args.should_keep_unary_factors
+         << std::endl;
+  stream << "# rao_blackwell      : " << args.should_rao_blackwellize
+         << std::endl;
+  stream << "# block_chains       : " << args.should_block_chains << std::endl;
+  stream << "# bitslice           : " << args.should_bitslice << std::endl;
+  stream << "# dedup_factors      : " << args.should_dedup_factors
+         << std::endl;
+  stream << "# reorder            : " << args.should_reorder << std::endl;
   stream << "################################################" << std::endl;
   return stream;
 }
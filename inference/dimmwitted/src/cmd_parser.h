@@ -35,22 +35,93 @@ class CmdParser {
   std::vector<std::string> domain_file;
   std::vector<std::string> factor_file;
   std::vector<std::string> weight_file;
+  // weight values (e.g., learned by a previous run) to start from
+  std::vector<std::string> learned_weight_file;
+  // chain assignments (e.g., left by a previous run) to start sampling from
+  std::vector<std::string> init_chains_file;
   std::string output_folder;
 
   size_t n_learning_epoch;
+  size_t n_pl_epoch;
   size_t n_inference_epoch;
   size_t n_datacopy;
   size_t n_threads;
   size_t burn_in;
+  // iterations of the mean-field approximation to start inference from
+  size_t mean_field_iterations;
+  // temperature to anneal from in map mode
+  double map_temperature;
+  // to stop inference before n_inference_epoch once the marginals converge
+  size_t convergence_interval;
+  // max joint assignments of a component to enumerate instead of sampling
+  size_t exact_component_states;
+  double inference_rhat;
+  // highest temperature of the copies in parallel tempering (0 for none), and
+  // the number of epochs between swaps
+  double max_temperature;
+  size_t tempering_interval;
+  // lowest visit rate per epoch of a variable in adaptive-scan inference
+  // relative to the average (0 for a plain sweep)
+  double min_scan_rate;
+  double inference_delta;
+  inference_engine_t inference_engine;
+  // fraction of the previous message kept in a belief propagation update
+  double bp_damping;
   double stepsize;
   double stepsize2;
   double decay;
   double reg_param;
   regularization_t regularization;
+  // values of stepsize, decay, and reg_param to try in sweep mode, i.e., all
+  // the ones given, and the fraction of evidence held out to compare them
+  std::vector<double> sweep_stepsizes;
+  std::vector<double> sweep_decays;
+  std::vector<double> sweep_reg_params;
+  double holdout_fraction;
+
+  // to average weights with other processes through shared memory
+  std::string shared_weights;
+  size_t shared_weights_rank;
+  size_t shared_weights_nprocs;
+  size_t shared_weights_sync;
+
+  // number of epochs between checkpoints (0 for none), and whether to resume
+  // from the last checkpoint in output_folder
+  size_t checkpoint_interval;
+  bool should_resume;
+  // inference_result.checkpoint in output_folder, one per run in sweep mode
+  std::string checkpoint_file;
+  learning_sweep_t learning_sweep;
+  // fraction of variables visited per learning epoch
+  double learning_fraction;
 
   bool should_be_quiet;
   bool should_sample_evidence;
   bool should_learn_non_evidence;
+  // when on, subsample evidence and non-evidence variables separately
+  bool should_stratify_evidence;
+  // when on, never replace sampling with exact computation
+  bool should_force_gibbs;
+  // when on, also sample query variables whose Markov blanket is all evidence
+  bool should_sample_observed;
+  // when on, do not specialize factors to the evidence in inference
+  bool should_keep_evidence_factors;
+  // when on, do not fold unary factors into per-value biases in inference
+  bool should_keep_unary_factors;
+  // when on, tally the conditional probabilities instead of the samples
+  bool should_rao_blackwellize;
+  // when on, write the connected components of the factor graph
+  bool should_dump_components;
+  // when on, write the final state of the chains for --init_chains
+  bool should_dump_chains;
+  // when on, sample chain-structured query variables jointly in inference
+  bool should_block_chains;
+  // when on, sample 64 chains at once in inference with one bit each
+  bool should_bitslice;
+  // when on, merge identical factors into one at load time
+  bool should_dedup_factors;
+  // when on, renumber variables and factors so neighbors are close in memory
+  bool should_reorder;
 
   // when on, train with VariableToFactor.truthiness instead of
   // Variable.assignment_dense
@@ -104,6 +104,12 @@ void parallel_copy(const std::unique_ptr<T[]> &src, std::unique_ptr<T[]> &dst,
 
 enum regularization_t { REG_L1, REG_L2 };
 
+// how a learning epoch visits the factor graph
+enum learning_sweep_t { SWEEP_VARIABLE, SWEEP_FACTOR };
+
+// how inference estimates the marginals
+enum inference_engine_t { ENGINE_GIBBS, ENGINE_BP };
+
 inline bool fast_exact_is_equal(double a, double b) {
   return (a <= b && b <= a);
 }
@@ -131,6 +137,13 @@ inline double logadd(double log_a, double log_b) {
   return (log_a + log1p(exp(negative_absolute_difference)));
 }
 
+/**
+ * Mixes value into hash, as boost::hash_combine does
+ */
+inline size_t hash_combine(size_t hash, size_t value) {
+  return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
 }  // namespace dd
 
 #endif  // DIMMWITTED_COMMON_H_
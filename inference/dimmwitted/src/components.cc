@@ -0,0 +1,123 @@
+#include "components.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace dd {
+
+// root of the set x belongs to, halving the path along the way
+static inline size_t find(std::atomic<size_t> parent[], size_t x) {
+  while (true) {
+    size_t p = parent[x].load(std::memory_order_relaxed);
+    if (p == x) return x;
+    size_t gp = parent[p].load(std::memory_order_relaxed);
+    if (p != gp) parent[x].compare_exchange_weak(p, gp);
+    x = gp;
+  }
+}
+
+// merges the sets of a and b, always under the smaller root, so every root
+// ends up being the smallest variable id of its component
+static inline void unite(std::atomic<size_t> parent[], size_t a, size_t b) {
+  while (true) {
+    a = find(parent, a);
+    b = find(parent, b);
+    if (a == b) return;
+    if (a > b) std::swap(a, b);
+    size_t expected = b;
+    if (parent[b].compare_exchange_strong(expected, a)) return;
+    // b got linked under another root meanwhile, so retry
+  }
+}
+
+ConnectedComponents::ConnectedComponents(const FactorGraph &fg,
+                                         size_t n_threads)
+    : num_components(0),
+      component_of(new size_t[fg.size.num_variables]),
+      vids(new size_t[fg.size.num_variables]) {
+  const size_t nvar = fg.size.num_variables;
+  const size_t nfactor = fg.size.num_factors;
+  std::unique_ptr<std::atomic<size_t>[]> parent(
+      new std::atomic<size_t>[nvar]);
+  for (size_t i = 0; i < nvar; ++i) parent[i] = i;
+
+  // union the variables of each factor, with factors split among threads
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(std::thread([&fg, &parent, nfactor, n_threads, t]() {
+      size_t chunk = nfactor / n_threads + 1;
+      size_t factor_end = std::min(nfactor, chunk * (t + 1));
+      for (size_t i = chunk * t; i < factor_end; ++i) {
+        const Factor &factor = fg.factors[i];
+        if (factor.num_vars < 2) continue;
+        size_t first = fg.get_factor_vif_at(factor, 0).vid;
+        for (size_t j = 1; j < factor.num_vars; ++j)
+          unite(parent.get(), first, fg.get_factor_vif_at(factor, j).vid);
+      }
+    }));
+  }
+  for (auto &t : threads) t.join();
+
+  // number the components in the order of their roots, which come first
+  std::vector<size_t> sizes;
+  for (size_t vid = 0; vid < nvar; ++vid) {
+    size_t root = find(parent.get(), vid);
+    if (root == vid) {
+      component_of[vid] = num_components++;
+      sizes.push_back(0);
+      has_query.push_back(false);
+      has_evidence.push_back(false);
+    } else {
+      component_of[vid] = component_of[root];
+    }
+    size_t c = component_of[vid];
+    ++sizes[c];
+    if (fg.variables[vid].is_evid)
+      has_evidence[c] = true;
+    else
+      has_query[c] = true;
+  }
+
+  // group the variable ids by component
+  component_base.resize(num_components + 1);
+  component_base[0] = 0;
+  for (size_t c = 0; c < num_components; ++c)
+    component_base[c + 1] = component_base[c] + sizes[c];
+  std::vector<size_t> next(component_base.begin(), component_base.end() - 1);
+  for (size_t vid = 0; vid < nvar; ++vid) vids[next[component_of[vid]]++] = vid;
+}
+
+std::vector<size_t> ConnectedComponents::inference_vids(
+    bool should_keep_evidence, const std::vector<bool> &is_skipped) const {
+  std::vector<size_t> result;
+  for (size_t c = 0; c < num_components; ++c) {
+    if (!has_query[c] && !should_keep_evidence) continue;
+    if (c < is_skipped.size() && is_skipped[c]) continue;
+    result.insert(result.end(), &vids[component_base[c]],
+                  &vids[component_base[c + 1]]);
+  }
+  return result;
+}
+
+void ConnectedComponents::dump(const FactorGraph &fg,
+                               const std::string &folder) const {
+  std::string filename_comps(folder + "/mat_components_hasevids");
+  std::string filename_vars(folder + "/mat_active_components");
+  std::cout << "DUMPING... TEXT    : " << filename_comps << std::endl;
+  std::cout << "DUMPING... TEXT    : " << filename_vars << std::endl;
+  std::ofstream fout_comps(filename_comps);
+  std::ofstream fout_vars(filename_vars);
+  size_t active_id = 0;
+  for (size_t c = 0; c < num_components; ++c) {
+    if (!has_query[c]) continue;
+    fout_comps << active_id << " " << has_evidence[c] << "\n";
+    for (size_t i = component_base[c]; i < component_base[c + 1]; ++i)
+      fout_vars << fg.original_vid(vids[i]) << " " << active_id << "\n";
+    ++active_id;
+  }
+}
+
+}  // namespace dd
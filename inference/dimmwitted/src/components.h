@@ -0,0 +1,64 @@
+#ifndef DIMMWITTED_COMPONENTS_H_
+#define DIMMWITTED_COMPONENTS_H_
+
+#include "factor_graph.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dd {
+
+/**
+ * Connected components of a factor graph, i.e., groups of variables connected
+ * through factors, labeled with a parallel union-find over the vifs.
+ *
+ * Components are numbered in the order of their smallest variable id, and
+ * the variables of each one are kept in increasing id order, so visiting them
+ * component by component stays close to the id order.
+ */
+class ConnectedComponents {
+ public:
+  size_t num_components;
+  // component of each variable
+  std::unique_ptr<size_t[]> component_of;
+  // variable ids grouped by component, where the ones of component c are at
+  // [component_base[c], component_base[c + 1])
+  std::unique_ptr<size_t[]> vids;
+  std::vector<size_t> component_base;
+  // whether each component has any query or evidence variables
+  std::vector<bool> has_query;
+  std::vector<bool> has_evidence;
+
+  /**
+   * Labels the components of the given (indexed) factor graph using n_threads
+   * threads.
+   */
+  ConnectedComponents(const FactorGraph &fg, size_t n_threads);
+
+  inline size_t size_of(size_t component) const {
+    return component_base[component + 1] - component_base[component];
+  }
+
+  /**
+   * Returns the ids of variables to sample for inference, component by
+   * component, dropping the components without any query variable unless
+   * should_keep_evidence, and those marked in is_skipped (if given).
+   */
+  std::vector<size_t> inference_vids(
+      bool should_keep_evidence,
+      const std::vector<bool> &is_skipped = std::vector<bool>()) const;
+
+  /**
+   * Writes the components with any query variable as
+   * mat_components_hasevids (a "component has_evidence" line for each) and
+   * mat_active_components (a "variable component" line for each of their
+   * variables, by their original ids in the given factor graph) into the
+   * given folder, numbering them from 0.
+   */
+  void dump(const FactorGraph &fg, const std::string &folder) const;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_COMPONENTS_H_
@@ -1,26 +1,40 @@
 #include "dimmwitted.h"
 #include "assert.h"
+#include "belief_propagation.h"
 #include "bin2text.h"
 #include "binary_format.h"
+#include "bitsliced_sampler.h"
+#include "components.h"
+#include "mean_field.h"
 #include "numa_nodes.h"
 #include "common.h"
 #include "factor_graph.h"
 #include "gibbs_sampler.h"
 #include "text2bin.h"
 
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <map>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
 
 namespace dd {
 
+// identifies checkpoint files written by DimmWitted::save_checkpoint
+static const char CHECKPOINT_MAGIC[8] = {'D', 'W', 'C', 'K',
+                                         'P', 'T', '0', '2'};
+
 // the command-line entry point
 int dw(int argc, const char *const argv[]) {
   // available modes
   const std::map<std::string, int (*)(const CmdParser &)> MODES = {
       {"gibbs", gibbs},  // to do the learning and inference with Gibbs sampling
+      {"map", gibbs},    // to do the learning and find the MAP assignment
+      {"sweep", sweep},  // to compare the weights learned with hyperparameters
       {"text2bin", text2bin},  // to generate binary factor graphs from TSV
       {"bin2text", bin2text},  // to dump TSV of binary factor graphs
   };
@@ -34,7 +48,7 @@ int dw(int argc, const char *const argv[]) {
   return (mode != MODES.end()) ? mode->second(cmd_parser) : 1;
 }
 
-int gibbs(const CmdParser &args) {
+FactorGraph *load_factor_graph(const CmdParser &args) {
   // number of NUMA nodes
   size_t n_numa_node = NumaNodes::num_configured();
   // number of max threads per NUMA node
@@ -65,10 +79,23 @@ int gibbs(const CmdParser &args) {
   std::cout << "\tloading factor graph..." << std::endl;
   fg->load_variables(args.variable_file);
   fg->load_weights(args.weight_file);
+  fg->load_weight_values(args.learned_weight_file);
   fg->load_domains(args.domain_file);
   fg->load_factors(args.factor_file);
   std::cout << "Factor graph loaded:\t" << fg->size << std::endl;
   fg->safety_check();
+  if (args.should_dedup_factors) {
+    Timer t;
+    size_t num_merged = fg->deduplicate_factors();
+    std::cout << "Factor graph deduplicated:\t" << num_merged
+              << " factors merged (" << t.elapsed() << " sec.)" << std::endl;
+  }
+  if (args.should_reorder) {
+    Timer t;
+    fg->reorder_by_locality();
+    std::cout << "Factor graph reordered:\t" << t.elapsed() << " sec."
+              << std::endl;
+  }
   fg->construct_index();
   std::cout << "Factor graph indexed:\t" << fg->size << std::endl;
 
@@ -77,6 +104,12 @@ int gibbs(const CmdParser &args) {
     std::cout << *fg << std::endl;
   }
 
+  return fg;
+}
+
+int gibbs(const CmdParser &args) {
+  FactorGraph *fg = load_factor_graph(args);
+
   // Initialize Gibbs sampling application.
   DimmWitted dw(fg, fg->weights.get(), args);
 
@@ -84,19 +117,103 @@ int gibbs(const CmdParser &args) {
 
   dw.dump_weights();
 
-  dw.inference();
+  if (args.app_name == "map") {
+    dw.map();
+    dw.dump_map();
+  } else {
+    dw.inference();
 
-  if (dw.opts.n_inference_epoch > 0) {
-    // dump only if we did any sampling at all
-    dw.aggregate_results_and_dump();
+    if (dw.opts.n_inference_epoch > 0) {
+      // dump only if we did any sampling at all
+      dw.aggregate_results_and_dump();
+    }
   }
 
+  if (args.should_dump_chains) dw.dump_chains();
+
+  return 0;
+}
+
+int sweep(const CmdParser &args) {
+  std::unique_ptr<FactorGraph> fg(load_factor_graph(args));
+
+  // hold out evidence evenly spread over the variables by turning it into
+  // query variables for learning
+  std::vector<size_t> heldout_vids;
+  double acc = 0;
+  for (size_t vid = 0; vid < fg->size.num_variables; ++vid) {
+    Variable &variable = fg->variables[vid];
+    if (!variable.is_evid) continue;
+    acc += args.holdout_fraction;
+    if (acc < 1) continue;
+    acc -= 1;
+    variable.is_evid = false;
+    heldout_vids.push_back(vid);
+  }
+  std::cout << "HELD-OUT EVIDENCE: " << heldout_vids.size() << " variables"
+            << std::endl;
+
+  std::string filename(args.output_folder + "/inference_result.out.sweep.text");
+  std::ofstream fout(filename);
+  double best_score = -INFINITY;
+  size_t i_run = 0;
+  for (double stepsize : args.sweep_stepsizes) {
+    for (double decay : args.sweep_decays) {
+      for (double reg_param : args.sweep_reg_params) {
+        CmdParser run_args(args);
+        run_args.stepsize = stepsize;
+        run_args.decay = decay;
+        run_args.reg_param = reg_param;
+        // so resuming a run never picks up where another one left off
+        run_args.checkpoint_file += "." + std::to_string(i_run);
+
+        // each run learns on its own copy from the same initial weights
+        DimmWitted dw(new FactorGraph(*fg), fg->weights.get(), run_args);
+        dw.learn();
+        double score = dw.log_pseudo_likelihood(heldout_vids);
+        std::cout << "SWEEP RUN " << i_run++ << " (alpha " << stepsize
+                  << ", diminish " << decay << ", reg_param " << reg_param
+                  << "): HELD-OUT LOG PSEUDO-LIKELIHOOD " << score
+                  << std::endl;
+        fout << stepsize << " " << decay << " " << reg_param << " " << score
+             << std::endl;
+
+        // keep the weights of the best run so far
+        if (score > best_score || i_run == 1) {
+          best_score = score;
+          dw.dump_weights();
+        }
+      }
+    }
+  }
+  fout.close();
+  std::cout << "DUMPING... TEXT    : " << filename << std::endl;
+
   return 0;
 }
 
 DimmWitted::DimmWitted(FactorGraph *p_cfg, const Weight weights[],
                        const CmdParser &opts)
-    : n_samplers_(opts.n_datacopy), weights(weights), opts(opts) {
+    : n_samplers_(opts.n_datacopy),
+      is_exact_unary_(!opts.should_force_gibbs &&
+                      p_cfg->has_only_unary_factors()),
+      is_resumed_(false),
+      is_resumed_in_inference_(false),
+      resumed_epoch_(0),
+      resumed_stepsize_(opts.stepsize),
+      weights(weights),
+      opts(opts) {
+  if (is_exact_unary_)
+    std::cout << "All factors are unary: learning and inference are exact "
+                 "(use --force_gibbs to sample anyway)"
+              << std::endl;
+  // a query variable then has the same conditional in both chains, so its
+  // expected gradient is zero and there is nothing to sample for it
+  if (is_exact_unary_ && opts.should_learn_non_evidence)
+    std::cout << "learn_non_evidence has no effect when all factors are "
+                 "unary (use --force_gibbs to sample non-evidence anyway)"
+              << std::endl;
+
   size_t n_thread_per_numa =
       std::max(size_t(1), opts.n_threads / opts.n_datacopy);
 
@@ -116,18 +233,177 @@ DimmWitted::DimmWitted(FactorGraph *p_cfg, const Weight weights[],
         weights, numa_nodes, n_thread_per_numa, i, opts));
     ++i;
   }
+
+  // sample each connected component on the same thread as much as possible,
+  // and none of those without any query variable or small enough to
+  // enumerate
+  {
+    ConnectedComponents components(samplers[0].fg, opts.n_threads);
+    if (opts.exact_component_states > 0 && !opts.should_force_gibbs &&
+        !opts.should_sample_evidence)
+      exact_inference_.reset(new ExactInference(
+          samplers[0].fg, components, opts.exact_component_states));
+    std::vector<size_t> vids = components.inference_vids(
+        opts.should_sample_evidence,
+        exact_inference_ ? exact_inference_->is_exact : std::vector<bool>());
+    if (opts.should_block_chains && !opts.should_sample_evidence)
+      chain_sampler_.reset(new ChainSampler(samplers[0].fg, vids));
+    std::cout << "CONNECTED COMPONENTS: " << components.num_components << " ("
+              << (exact_inference_ ? exact_inference_->num_components() : 0)
+              << " exact, "
+              << (chain_sampler_ ? chain_sampler_->num_chains() : 0)
+              << " chains, " << vids.size() << " variables to sample)"
+              << std::endl;
+    for (auto &sampler : samplers) {
+      sampler.schedule_inference(vids);
+      if (chain_sampler_) sampler.schedule_chains(*chain_sampler_);
+    }
+    if (opts.should_dump_components)
+      components.dump(samplers[0].fg, opts.output_folder);
+  }
+
+  if (!opts.shared_weights.empty()) {
+    shared_weights_.reset(new SharedWeights(
+        opts.shared_weights, opts.shared_weights_rank,
+        opts.shared_weights_nprocs, samplers[0].infrs.nweights));
+  }
+
+  // warm start the chains of all copies from the same state
+  if (!opts.init_chains_file.empty()) {
+    samplers[0].infrs.load_chains(opts.init_chains_file);
+    for (size_t i = 1; i < n_samplers_; ++i)
+      samplers[0].infrs.copy_chains_to(samplers[i].infrs);
+  }
+
+  // copies at temperatures growing geometrically from 1 to the highest one
+  if (opts.max_temperature > 0) {
+    for (size_t i = 0; i < n_samplers_; ++i) {
+      temperatures_.push_back(
+          pow(opts.max_temperature, (double)i / (n_samplers_ - 1)));
+    }
+    swap_rand_seed_[0] = rand();
+    swap_rand_seed_[1] = rand();
+    swap_rand_seed_[2] = rand();
+  }
+
+  if (opts.should_resume) is_resumed_ = load_checkpoint();
 }
 
 void DimmWitted::inference() {
-  const size_t n_epoch = compute_n_epochs(opts.n_inference_epoch);
+  // only the copy at temperature 1 is tallied in parallel tempering
+  const bool is_tempering = !temperatures_.empty();
+  const size_t n_epoch = is_tempering
+                             ? opts.n_inference_epoch
+                             : compute_n_epochs(opts.n_inference_epoch);
   const size_t nvar = samplers[0].fg.size.num_variables;
   const bool should_show_progress = !opts.should_be_quiet;
   Timer t_total, t;
 
-  for (auto &sampler : samplers) sampler.infrs.clear_variabletally();
+  // continue where the checkpoint left off, keeping the tallies so far
+  const size_t first_epoch = is_resumed_in_inference_ ? resumed_epoch_ : 0;
+  if (first_epoch == 0) {
+    for (auto &sampler : samplers) sampler.infrs.clear_variabletally();
+    // start the chains near typical states instead of where they are
+    if (opts.mean_field_iterations > 0 && opts.init_chains_file.empty()) {
+      if (MeanField::can_run(samplers[0].fg, opts.should_sample_evidence)) {
+        t.restart();
+        MeanField mean_field(samplers[0].fg, opts.should_sample_evidence);
+        size_t n_iterations = mean_field.run(
+            samplers[0].infrs, opts.mean_field_iterations, opts.n_threads);
+        for (auto &sampler : samplers) {
+          unsigned short seed[3] = {(unsigned short)rand(),
+                                    (unsigned short)rand(),
+                                    (unsigned short)rand()};
+          mean_field.sample_chains(sampler.infrs, seed);
+        }
+        std::cout << "MEAN-FIELD INIT TIME: " << t.elapsed() << " sec. ("
+                  << n_iterations << " iterations)" << std::endl;
+      } else {
+        std::cout << "mean_field_init needs factors with at most "
+                  << MeanField::MAX_FACTOR_STATES
+                  << " joint assignments to their query variables, so "
+                     "starting the chains as usual"
+                  << std::endl;
+      }
+    }
+    // variables with only evidence around are not sampled but computed once
+    for (auto &sampler : samplers) sampler.compute_observed_marginals();
+    for (auto &sampler : samplers) sampler.wait();
+    // so are small components, just once for all copies
+    if (exact_inference_)
+      exact_inference_->compute_marginals(samplers[0].infrs, opts.n_threads);
+  }
+
+  if (is_exact_unary_ && n_epoch > 0) {
+    // marginals of independent variables are just their conditionals
+    t.restart();
+    for (auto &sampler : samplers) sampler.compute_marginals();
+    for (auto &sampler : samplers) sampler.wait();
+    std::cout << "EXACT INFERENCE TIME: " << t.elapsed() << " sec."
+              << std::endl;
+    return;
+  }
+
+  if (opts.inference_engine == ENGINE_BP) {
+    // approximate the rest of the marginals without sampling
+    t.restart();
+    BeliefPropagation bp(samplers[0].fg, opts.should_sample_evidence);
+    size_t n_iterations =
+        bp.run(samplers[0].infrs, opts.n_inference_epoch, opts.bp_damping,
+               opts.inference_delta, opts.n_threads);
+    bp.store_marginals(samplers[0].infrs);
+    std::cout << "BELIEF PROPAGATION TIME: " << t.elapsed() << " sec. ("
+              << n_iterations << " iterations)" << std::endl;
+    return;
+  }
+
+  if (opts.should_bitslice && first_epoch == 0) {
+    if (BitslicedSampler::can_sample(samplers[0].fg)) {
+      // many more chains of the first copy instead of one for each copy
+      t.restart();
+      BitslicedSampler bitsliced(samplers[0].fg, samplers[0].infrs,
+                                 opts.should_sample_evidence);
+      bitsliced.sample(samplers[0].infrs, opts.burn_in, opts.n_threads, false);
+      bitsliced.sample(samplers[0].infrs, opts.n_inference_epoch,
+                       opts.n_threads);
+      bitsliced.store_chain(samplers[0].infrs);
+      std::cout << "BITSLICED INFERENCE TIME: " << t.elapsed() << " sec. ("
+                << BitslicedSampler::NUM_CHAINS << " chains)" << std::endl;
+      return;
+    }
+    std::cout << "bitslice needs only boolean variables and logical factors, "
+                 "so sampling one chain per copy" << std::endl;
+  }
+
+  simplify_factor_graphs();
+
+  // copies at their temperatures in parallel tempering (if any)
+  for (size_t i = 0; i < temperatures_.size(); ++i)
+    samplers[i].set_temperature(temperatures_[i]);
+  size_t n_swaps = 0;
+
+  // burn-in epochs, unless resuming in the middle of inference
+  const size_t n_burn_in_epoch =
+      first_epoch > 0 ? 0
+                      : is_tempering ? opts.burn_in
+                                     : compute_n_epochs(opts.burn_in);
+  for (size_t i_epoch = 0; i_epoch < n_burn_in_epoch; ++i_epoch)
+    n_swaps += sample_epoch(i_epoch, false);
+  if (n_burn_in_epoch > 0)
+    std::cout << "BURN-IN TIME: " << t_total.elapsed() << " sec." << std::endl;
+
+  // marginals at the last convergence check, if inference may stop early
+  const bool should_check_convergence =
+      (opts.inference_rhat > 0 && n_samplers_ > 1) || opts.inference_delta > 0;
+  std::unique_ptr<double[]> prev_marginals;
+  if (should_check_convergence) {
+    prev_marginals.reset(new double[samplers[0].infrs.ntallies]);
+    std::fill(prev_marginals.get(),
+              prev_marginals.get() + samplers[0].infrs.ntallies, INFINITY);
+  }
 
   // inference epochs
-  for (size_t i_epoch = 0; i_epoch < n_epoch; ++i_epoch) {
+  for (size_t i_epoch = first_epoch; i_epoch < n_epoch; ++i_epoch) {
     if (should_show_progress) {
       std::streamsize ss = std::cout.precision();
       std::cout << std::setprecision(3) << "INFERENCE EPOCH "
@@ -140,10 +416,7 @@ void DimmWitted::inference() {
     t.restart();
 
     // sample
-    for (auto &sampler : samplers) sampler.sample(i_epoch);
-
-    // wait for samplers to finish
-    for (auto &sampler : samplers) sampler.wait();
+    n_swaps += sample_epoch(i_epoch, true);
 
     double elapsed = t.elapsed();
     if (should_show_progress) {
@@ -153,33 +426,188 @@ void DimmWitted::inference() {
                 << std::endl
                 << std::setprecision(ss);
     }
+
+    if (opts.checkpoint_interval > 0 &&
+        (i_epoch + 1) % opts.checkpoint_interval == 0)
+      save_checkpoint(true, i_epoch + 1, 0);
+
+    if (should_check_convergence &&
+        (i_epoch + 1) % opts.convergence_interval == 0 &&
+        has_converged(prev_marginals)) {
+      std::cout << "INFERENCE CONVERGED AFTER EPOCH "
+                << ((i_epoch + 1) * n_samplers_ - 1) << std::endl;
+      break;
+    }
   }
 
+  for (auto &sampler : samplers) sampler.set_temperature(1);
+  if (is_tempering)
+    std::cout << "TEMPERING SWAPS ACCEPTED: " << n_swaps << std::endl;
+
   double elapsed = t_total.elapsed();
   std::cout << "TOTAL INFERENCE TIME: " << elapsed << " sec." << std::endl;
 }
 
+void DimmWitted::simplify_factor_graphs() {
+  Timer t;
+  size_t num_constant = 0;
+  size_t num_stripped = 0;
+  size_t num_folded = 0;
+  for (auto &sampler : samplers) {
+    if (!opts.should_sample_evidence && !opts.should_keep_evidence_factors)
+      sampler.fg.simplify_given_evidence(num_constant, num_stripped);
+    if (!opts.should_keep_unary_factors)
+      num_folded =
+          sampler.fg.fold_unary_factors(sampler.infrs.weight_values.get());
+  }
+  std::cout << "SIMPLIFIED FACTOR GRAPH: " << num_constant
+            << " constant factors, " << num_stripped << " literals stripped, "
+            << num_folded << " unary factors folded (" << t.elapsed()
+            << " sec.)" << std::endl;
+}
+
+size_t DimmWitted::sample_epoch(size_t i_epoch, bool should_tally) {
+  const bool is_tempering = !temperatures_.empty();
+  for (size_t i = 0; i < n_samplers_; ++i)
+    samplers[i].sample(i_epoch, should_tally && (i == 0 || !is_tempering));
+  for (auto &sampler : samplers) sampler.wait();
+
+  if (!is_tempering || (i_epoch + 1) % opts.tempering_interval != 0) return 0;
+  return exchange_chains((i_epoch + 1) / opts.tempering_interval);
+}
+
+size_t DimmWitted::exchange_chains(size_t parity) {
+  std::vector<double> log_potentials;
+  for (const auto &sampler : samplers)
+    log_potentials.push_back(log_potential(sampler));
+
+  size_t n_accepted = 0;
+  for (size_t i = parity % 2; i + 1 < n_samplers_; i += 2) {
+    // ratio of the probabilities of the swapped chains to the current ones
+    // at their temperatures
+    double log_ratio = (1 / temperatures_[i] - 1 / temperatures_[i + 1]) *
+                       (log_potentials[i + 1] - log_potentials[i]);
+    if (log_ratio >= 0 || erand48(swap_rand_seed_) < exp(log_ratio)) {
+      std::swap(samplers[i].infrs.assignments_evid,
+                samplers[i + 1].infrs.assignments_evid);
+      ++n_accepted;
+    }
+  }
+  return n_accepted;
+}
+
+// To placate linker error "undefined reference" (see variable.cc)
+constexpr size_t DimmWitted::MAX_ICM_SWEEPS;
+
+void DimmWitted::map() {
+  const size_t n_epoch = opts.n_inference_epoch;
+  simplify_factor_graphs();
+  Timer t;
+
+  // annealed Gibbs sampling, cooling down linearly, each copy on its own
+  std::atomic<size_t> num_changed(0);
+  if (opts.map_temperature > 0) {
+    for (size_t i_epoch = 0; i_epoch < n_epoch; ++i_epoch) {
+      double temperature = opts.map_temperature * (n_epoch - i_epoch) / n_epoch;
+      for (auto &sampler : samplers)
+        sampler.anneal(1 / temperature, false, num_changed);
+      for (auto &sampler : samplers) sampler.wait();
+    }
+  }
+
+  // then greedily up to a local maximum
+  size_t n_icm_sweeps = 0;
+  do {
+    num_changed = 0;
+    for (auto &sampler : samplers) sampler.anneal(1, true, num_changed);
+    for (auto &sampler : samplers) sampler.wait();
+    ++n_icm_sweeps;
+  } while (num_changed > 0 && n_icm_sweeps < MAX_ICM_SWEEPS);
+
+  std::cout << "MAP TIME: " << t.elapsed() << " sec. (" << n_icm_sweeps
+            << " ICM sweeps" << (num_changed > 0 ? ", not settled" : "")
+            << ")" << std::endl;
+}
+
+double DimmWitted::log_potential(const GibbsSampler &sampler) const {
+  const FactorGraph &fg = sampler.fg;
+  const InferenceResult &infrs = sampler.infrs;
+  double sum = 0;
+  for (size_t i = 0; i < fg.size.num_factors; ++i) {
+    const Factor &factor = fg.factors[i];
+    sum += infrs.weight_values[factor.weight_id] *
+           factor.potential(fg.vifs.get(), infrs.assignments_evid.get());
+  }
+  return sum;
+}
+
+void DimmWitted::dump_map() {
+  size_t best = 0;
+  double best_log_potential = log_potential(samplers[0]);
+  for (size_t i = 1; i < n_samplers_; ++i) {
+    double pot = log_potential(samplers[i]);
+    if (pot > best_log_potential) {
+      best = i;
+      best_log_potential = pot;
+    }
+  }
+  std::cout << "MAP LOG POTENTIAL: " << best_log_potential << std::endl;
+
+  const FactorGraph &fg = samplers[best].fg;
+  const InferenceResult &infrs = samplers[best].infrs;
+  std::string filename_text(opts.output_folder +
+                            "/inference_result.out.map.text");
+  std::cout << "DUMPING... TEXT    : " << filename_text << std::endl;
+  std::ofstream fout_text(filename_text);
+  for (size_t vid = 0; vid < fg.size.num_variables; ++vid) {
+    const Variable &variable = fg.variables[vid];
+    if (variable.is_evid && !opts.should_sample_evidence) continue;
+    size_t value = infrs.assignments_evid[vid];
+    fout_text << fg.original_vid(vid) << " "
+              << (variable.is_boolean() ? value
+                                        : fg.get_var_value_at(variable, value))
+              << "\n";
+  }
+}
+
 void DimmWitted::learn() {
   InferenceResult &infrs = samplers[0].infrs;
 
+  const size_t n_pl_epoch = compute_n_epochs(opts.n_pl_epoch);
   const size_t n_epoch = compute_n_epochs(opts.n_learning_epoch);
   const size_t nweight = infrs.nweights;
   const double decay = opts.decay;
+  // an epoch visiting a fraction of the variables only decays the stepsize
+  // by that fraction, so the schedule per variable visited stays the same
+  const double subsampled_decay = pow(decay, opts.learning_fraction);
   const bool should_show_progress = !opts.should_be_quiet;
   Timer t_total, t;
 
-  double current_stepsize = opts.stepsize;
+  // continue where the checkpoint left off, skipping learning altogether if it
+  // was taken during inference
+  const size_t first_pass = !is_resumed_ ? 0
+                            : is_resumed_in_inference_ ? n_pl_epoch + n_epoch
+                                                        : resumed_epoch_;
+  double current_stepsize = is_resumed_ ? resumed_stepsize_ : opts.stepsize;
   const std::unique_ptr<double[]> prev_weights(new double[nweight]);
   COPY_ARRAY_IF_POSSIBLE(infrs.weight_values.get(), nweight,
                          prev_weights.get());
+  if (shared_weights_) shared_weights_->start_from(infrs);
 
   bool stop = false;
 
-  // learning epochs
-  for (size_t i_epoch = 0; !stop && i_epoch < n_epoch; ++i_epoch) {
+  // pseudo-likelihood epochs (if any) warm start the learning epochs
+  for (size_t i_pass = first_pass; !stop && i_pass < n_pl_epoch + n_epoch;
+       ++i_pass) {
+    const bool is_pl = i_pass < n_pl_epoch;
+    const size_t i_epoch = is_pl ? i_pass : i_pass - n_pl_epoch;
+    // only the per-variable sweeps subsample variables
+    const bool is_subsampled =
+        is_pl || is_exact_unary_ || opts.learning_sweep == SWEEP_VARIABLE;
     if (should_show_progress) {
       std::streamsize ss = std::cout.precision();
-      std::cout << std::setprecision(3) << "LEARNING EPOCH "
+      std::cout << std::setprecision(3)
+                << (is_pl ? "PSEUDO-LIKELIHOOD EPOCH " : "LEARNING EPOCH ")
                 << i_epoch * n_samplers_ << "~"
                 << ((i_epoch + 1) * n_samplers_ - 1) << "...." << std::flush
                 << std::setprecision(ss);
@@ -187,25 +615,147 @@ void DimmWitted::learn() {
 
     t.restart();
 
-    // performs stochastic gradient descent with sampling
-    for (auto &sampler : samplers) sampler.sample_sgd(current_stepsize);
+    if (is_pl || is_exact_unary_) {
+      // exact conditionals of evidence given its neighbors, no chains
+      // NOTE: with only unary factors, the pseudo-likelihood is the exact
+      // likelihood, i.e., this is plain (multinomial) logistic regression
+      for (auto &sampler : samplers)
+        sampler.pseudo_likelihood_sgd(current_stepsize);
+    } else if (opts.learning_sweep == SWEEP_FACTOR) {
+      // sample both chains for all variables first
+      for (auto &sampler : samplers) sampler.sample_chains();
+      for (auto &sampler : samplers) sampler.wait();
+      // then compute the gradient of each factor exactly once
+      for (auto &sampler : samplers) sampler.sgd_on_factors(current_stepsize);
+    } else {
+      // performs stochastic gradient descent with sampling
+      for (auto &sampler : samplers) sampler.sample_sgd(current_stepsize);
+    }
 
     // wait the samplers to finish
     for (auto &sampler : samplers) sampler.wait();
 
     stop = update_weights(infrs, t.elapsed(), current_stepsize, prev_weights);
 
+    // average with other processes periodically and after the last epoch
+    if (shared_weights_ && ((i_pass + 1) % opts.shared_weights_sync == 0 ||
+                            i_pass + 1 == n_pl_epoch + n_epoch))
+      shared_weights_->average(infrs);
+
     // assigned weights to all factor graphs
     for (size_t i = 1; i < n_samplers_; ++i)
       infrs.copy_weights_to(samplers[i].infrs);
 
-    current_stepsize *= decay;
+    current_stepsize *= is_subsampled ? subsampled_decay : decay;
+
+    if (opts.checkpoint_interval > 0 &&
+        (i_pass + 1) % opts.checkpoint_interval == 0)
+      save_checkpoint(false, i_pass + 1, current_stepsize);
   }
 
+  // so inference can be resumed without learning again
+  if (opts.checkpoint_interval > 0 && first_pass < n_pl_epoch + n_epoch)
+    save_checkpoint(true, 0, current_stepsize);
+
   double elapsed = t_total.elapsed();
   std::cout << "TOTAL LEARNING TIME: " << elapsed << " sec." << std::endl;
 }
 
+void DimmWitted::save_checkpoint(bool is_in_inference, size_t i_epoch,
+                                 double stepsize) {
+  const InferenceResult &infrs = samplers[0].infrs;
+  const std::string &filename = opts.checkpoint_file;
+  std::string filename_tmp(filename + ".tmp");
+  Timer t;
+
+  // write everything to a temporary file first, so a crash while writing
+  // leaves the previous checkpoint intact
+  std::ofstream fout(filename_tmp, std::ios::binary);
+  fout.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  uint64_t header[] = {is_in_inference,
+                       i_epoch,
+                       n_samplers_,
+                       infrs.nvars,
+                       infrs.nweights,
+                       infrs.ntallies,
+                       hash_loaded_weights(),
+                       opts.n_learning_epoch,
+                       opts.n_pl_epoch};
+  fout.write(reinterpret_cast<const char *>(header), sizeof(header));
+  fout.write(reinterpret_cast<const char *>(&stepsize), sizeof(stepsize));
+  for (const auto &sampler : samplers) sampler.infrs.save_state(fout);
+  fout.close();
+  if (!fout || std::rename(filename_tmp.c_str(), filename.c_str()) != 0) {
+    std::cerr << "[ERROR] Cannot write checkpoint " << filename << std::endl;
+    std::abort();
+  }
+
+  if (!opts.should_be_quiet)
+    std::cout << "CHECKPOINT " << (is_in_inference ? "INFERENCE" : "LEARNING")
+              << " EPOCH " << i_epoch * n_samplers_ << ": " << t.elapsed()
+              << " sec." << std::endl;
+}
+
+bool DimmWitted::load_checkpoint() {
+  const InferenceResult &infrs = samplers[0].infrs;
+  const std::string &filename = opts.checkpoint_file;
+  std::ifstream fin(filename, std::ios::binary);
+  if (!fin) {
+    std::cout << "NO CHECKPOINT TO RESUME FROM: " << filename << std::endl;
+    return false;
+  }
+
+  char magic[sizeof(CHECKPOINT_MAGIC)];
+  uint64_t header[9];
+  fin.read(magic, sizeof(magic));
+  fin.read(reinterpret_cast<char *>(header), sizeof(header));
+  fin.read(reinterpret_cast<char *>(&resumed_stepsize_),
+           sizeof(resumed_stepsize_));
+  if (!fin || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+    std::cerr << "[ERROR] Not a checkpoint: " << filename << std::endl;
+    std::abort();
+  }
+  if (header[2] != n_samplers_ || header[3] != infrs.nvars ||
+      header[4] != infrs.nweights || header[5] != infrs.ntallies) {
+    std::cerr << "[ERROR] Checkpoint " << filename << " is for "
+              << header[2] << " data copies, " << header[3] << " variables, "
+              << header[4] << " weights, and " << header[5]
+              << " tallies, which does not match" << std::endl;
+    std::abort();
+  }
+  // a graph of the same size but with other weights, or other epochs, would
+  // otherwise resume as if it were the same run
+  if (header[6] != hash_loaded_weights() ||
+      header[7] != opts.n_learning_epoch || header[8] != opts.n_pl_epoch) {
+    std::cerr << "[ERROR] Checkpoint " << filename << " is for other weights "
+              << "or " << header[7] << " learning and " << header[8]
+              << " pseudo-likelihood epochs, which does not match" << std::endl;
+    std::abort();
+  }
+  is_resumed_in_inference_ = header[0];
+  resumed_epoch_ = header[1];
+
+  for (auto &sampler : samplers) sampler.infrs.load_state(fin);
+  if (!fin) {
+    std::cerr << "[ERROR] Truncated checkpoint: " << filename << std::endl;
+    std::abort();
+  }
+
+  std::cout << "RESUMING FROM CHECKPOINT " << filename << " AT "
+            << (is_resumed_in_inference_ ? "INFERENCE" : "LEARNING")
+            << " EPOCH " << resumed_epoch_ * n_samplers_ << std::endl;
+  return true;
+}
+
+uint64_t DimmWitted::hash_loaded_weights() const {
+  size_t hash = 0;
+  for (size_t i = 0; i < samplers[0].infrs.nweights; ++i) {
+    hash = hash_combine(hash, std::hash<double>()(weights[i].weight));
+    hash = hash_combine(hash, weights[i].isfixed);
+  }
+  return hash;
+}
+
 bool DimmWitted::update_weights(InferenceResult &infrs, double elapsed,
                                 double stepsize,
                                 const std::unique_ptr<double[]> &prev_weights) {
@@ -242,6 +792,29 @@ bool DimmWitted::update_weights(InferenceResult &infrs, double elapsed,
   return false;
 }
 
+double DimmWitted::log_pseudo_likelihood(const std::vector<size_t> &vids) {
+  FactorGraph &fg = samplers[0].fg;
+  InferenceResult &infrs = samplers[0].infrs;
+  if (vids.empty()) return 0;
+
+  for (size_t vid : vids)
+    infrs.assignments_evid[vid] = fg.variables[vid].assignment_dense;
+  double sum = 0;
+  for (size_t vid : vids) {
+    const Variable &variable = fg.variables[vid];
+    double log_z = -INFINITY;
+    double observed = 0;
+    for (size_t value = 0; value < variable.cardinality; ++value) {
+      double pot = fg.potential(variable, value, infrs.assignments_evid.get(),
+                                infrs.weight_values.get());
+      log_z = logadd(log_z, pot);
+      if (value == variable.assignment_dense) observed = pot;
+    }
+    sum += observed - log_z;
+  }
+  return sum / vids.size();
+}
+
 void DimmWitted::dump_weights() {
   // learning weights snippets
   const InferenceResult &infrs = samplers[0].infrs;
@@ -255,6 +828,23 @@ void DimmWitted::dump_weights() {
   std::ofstream fout_text(filename_text);
   infrs.dump_weights_in_text(fout_text);
   fout_text.close();
+
+  // also in binary for --learned_weights or -w of the next run
+  std::string filename_bin(opts.output_folder +
+                           "/inference_result.out.weights.bin");
+  std::cout << "DUMPING... BINARY  : " << filename_bin << std::endl;
+  std::ofstream fout_bin(filename_bin, std::ios::binary);
+  infrs.dump_weights_in_binary(fout_bin);
+  fout_bin.close();
+}
+
+void DimmWitted::dump_chains() {
+  std::string filename_bin(opts.output_folder +
+                           "/inference_result.out.chains.bin");
+  std::cout << "DUMPING... BINARY  : " << filename_bin << std::endl;
+  std::ofstream fout_bin(filename_bin, std::ios::binary);
+  samplers[0].infrs.dump_chains_in_binary(fout_bin);
+  fout_bin.close();
 }
 
 void DimmWitted::aggregate_results_and_dump() {
@@ -276,6 +866,59 @@ void DimmWitted::aggregate_results_and_dump() {
   if (!opts.should_be_quiet) infrs.show_marginal_histogram(std::cout);
 }
 
+bool DimmWitted::has_converged(std::unique_ptr<double[]> &prev_marginals) {
+  const FactorGraph &fg = samplers[0].fg;
+  // the other copies are not tallied in parallel tempering
+  const size_t n_chains = temperatures_.empty() ? n_samplers_ : 1;
+  const bool should_check_rhat = opts.inference_rhat > 0 && n_chains > 1;
+  double max_rhat = 1;
+  double max_delta = 0;
+
+  for (size_t vid = 0; vid < fg.size.num_variables; ++vid) {
+    const Variable &variable = fg.variables[vid];
+    const double n = samplers[0].infrs.agg_nsamples[vid];
+    if (n < 2) continue;  // not sampled, e.g., evidence
+
+    for (size_t i = 0; i < variable.internal_cardinality(); ++i) {
+      const size_t idx = variable.var_val_base + i;
+      // per-copy marginals as Bernoulli means
+      double sum = 0, sum_sq = 0, within = 0;
+      for (size_t c = 0; c < n_chains; ++c) {
+        const InferenceResult &infrs = samplers[c].infrs;
+        double p = infrs.sample_tallies[idx] / infrs.agg_nsamples[vid];
+        sum += p;
+        sum_sq += p * p;
+        within += p * (1 - p);
+      }
+      double mean = sum / n_chains;
+
+      if (should_check_rhat) {
+        // Gelman-Rubin: within-copy variance W vs. the pooled estimate
+        // V = (n - 1) / n * W + B / n, where B / n is the variance of means
+        within = within / n_chains * n / (n - 1);
+        double between = (sum_sq - sum * mean) / (n_chains - 1);
+        double pooled = (n - 1) / n * within + between;
+        double rhat = within > 0 ? sqrt(pooled / within)
+                                 : between > 0 ? INFINITY : 1;
+        if (max_rhat < rhat) max_rhat = rhat;
+      }
+
+      double delta = fabs(mean - prev_marginals[idx]);
+      if (max_delta < delta) max_delta = delta;
+      prev_marginals[idx] = mean;
+    }
+  }
+
+  if (!opts.should_be_quiet) {
+    std::cout << "CONVERGENCE CHECK: ";
+    if (should_check_rhat) std::cout << "max_rhat=" << max_rhat << ",";
+    std::cout << "max_delta=" << max_delta << std::endl;
+  }
+
+  return (!should_check_rhat || max_rhat < opts.inference_rhat) &&
+         (opts.inference_delta == 0 || max_delta < opts.inference_delta);
+}
+
 // compute number of NUMA-aware epochs for learning or inference
 size_t DimmWitted::compute_n_epochs(size_t n_epoch) {
   return std::ceil((double)n_epoch / n_samplers_);
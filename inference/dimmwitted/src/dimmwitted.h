@@ -2,8 +2,10 @@
 #define DIMMWITTED_DIMMWITTED_H_
 
 #include "cmd_parser.h"
+#include "exact_inference.h"
 #include "factor_graph.h"
 #include "gibbs_sampler.h"
+#include "shared_weights.h"
 #include <memory>
 
 namespace dd {
@@ -18,6 +20,19 @@ int dw(int argc, const char* const argv[]);
  */
 int gibbs(const CmdParser& cmd_parser);
 
+/**
+ * Learns weights with every combination of the hyperparameters given on the
+ * command line, each on a copy of the factor graph loaded just once, and
+ * keeps the ones with the highest pseudo-likelihood of held-out evidence
+ */
+int sweep(const CmdParser& cmd_parser);
+
+/**
+ * Loads and indexes the factor graph given on the command line, to be owned
+ * by the caller
+ */
+FactorGraph* load_factor_graph(const CmdParser& cmd_parser);
+
 /**
  * Class for (NUMA-aware) gibbs sampling
  *
@@ -28,6 +43,30 @@ class DimmWitted {
  private:
   const size_t n_samplers_;
 
+  // whether all variables are independent, so learning and inference can be
+  // done exactly without sampling
+  const bool is_exact_unary_;
+
+  // small components whose marginals are computed exactly (if any)
+  std::unique_ptr<ExactInference> exact_inference_;
+
+  // chains of variables sampled jointly in inference (if any)
+  std::unique_ptr<ChainSampler> chain_sampler_;
+
+  // weights averaged with other processes (if any)
+  std::unique_ptr<SharedWeights> shared_weights_;
+
+  // temperature of each copy in parallel tempering (if any), and the RNG
+  // seed for accepting swaps of their chains
+  std::vector<double> temperatures_;
+  unsigned short swap_rand_seed_[3];
+
+  // progress restored from a checkpoint (see --resume)
+  bool is_resumed_;
+  bool is_resumed_in_inference_;
+  size_t resumed_epoch_;
+  double resumed_stepsize_;
+
  public:
   const Weight* const weights;  // TODO clarify ownership
 
@@ -65,6 +104,27 @@ class DimmWitted {
    */
   void inference();
 
+  /**
+   * Finds the most likely assignment (MAP) to the query variables in the evid
+   * chain of each copy, by Gibbs sampling annealed from --map_temperature
+   * toward zero over n_inference_epoch epochs, and then iterated conditional
+   * modes until no variable changes
+   */
+  void map();
+
+  /**
+   * Dumps the MAP assignment of the copy with the highest log potential
+   */
+  void dump_map();
+
+  /**
+   * Returns the average log conditional probability of the observed value of
+   * each given variable given the rest, i.e., its observed value for
+   * evidence or one of the given variables, and the value in the evid chain
+   * otherwise, e.g., for scoring the weights on held-out evidence
+   */
+  double log_pseudo_likelihood(const std::vector<size_t>& vids);
+
   /**
    * Aggregates results from different NUMA nodes
    * Dumps the inference result for variables
@@ -78,10 +138,80 @@ class DimmWitted {
    */
   void dump_weights();
 
+  /**
+   * Dumps the final state of the chains, e.g., for --init_chains of a later
+   * run
+   */
+  void dump_chains();
+
  private:
   bool update_weights(InferenceResult& infrs, double elapsed, double stepsize,
                       const std::unique_ptr<double[]>& prev_weights);
   size_t compute_n_epochs(size_t n_epoch);
+
+  // max number of ICM sweeps after annealing, in case parallel updates of
+  // neighbors keep flipping each other
+  static constexpr size_t MAX_ICM_SWEEPS = 100;
+
+  /**
+   * Returns the sum of weighted potentials of all factors given the evid
+   * chain of the sampler, i.e., the unnormalized log probability of its
+   * assignment.
+   */
+  double log_potential(const GibbsSampler& sampler) const;
+
+  /**
+   * Specializes the factors of every copy to the evidence before sampling in
+   * inference (see FactorGraph::simplify_given_evidence), unless evidence
+   * gets sampled or the factors are kept, and then folds the unary factors
+   * into per-value biases with the learned weights (see
+   * FactorGraph::fold_unary_factors), unless they are kept too
+   */
+  void simplify_factor_graphs();
+
+  /**
+   * Samples an inference epoch with all copies, tallying if should_tally, but
+   * only the one at temperature 1 in parallel tempering, whose copies then
+   * attempt to swap their chains after every tempering_interval epochs.
+   * Returns the number of swaps accepted.
+   */
+  size_t sample_epoch(size_t i_epoch, bool should_tally);
+
+  /**
+   * Attempts to swap the evid chains of copies at neighboring temperatures,
+   * pairing each even (or odd, if the given parity is odd) copy with the next
+   * one, with the Metropolis acceptance probability, and returns the number
+   * of swaps accepted
+   */
+  size_t exchange_chains(size_t parity);
+
+  /**
+   * Checks whether the marginals have converged enough to stop inference, by
+   * the R-hat across the copies (--inference_rhat) and/or the change since
+   * the last check of the marginals pooled over the copies
+   * (--inference_delta), which prev_marginals holds and gets updated.
+   */
+  bool has_converged(std::unique_ptr<double[]>& prev_marginals);
+
+  /**
+   * Writes the state of all samplers to a checkpoint in the output folder
+   * along with the progress, i.e., the phase, the epoch to continue from, and
+   * the current stepsize.
+   */
+  void save_checkpoint(bool is_in_inference, size_t i_epoch, double stepsize);
+
+  /**
+   * Restores the state and progress saved by save_checkpoint if the output
+   * folder has a checkpoint.
+   * Returns whether there was one.
+   */
+  bool load_checkpoint();
+
+  /**
+   * Returns a hash of the values and fixedness of the weights as loaded, which
+   * checkpoints record to resume only the run that wrote them.
+   */
+  uint64_t hash_loaded_weights() const;
 };
 
 }  // namespace dd
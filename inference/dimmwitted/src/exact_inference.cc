@@ -0,0 +1,132 @@
+#include "exact_inference.h"
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace dd {
+
+ExactInference::ExactInference(const FactorGraph &fg,
+                               const ConnectedComponents &components,
+                               size_t max_states)
+    : is_exact(components.num_components, false),
+      fg_(fg),
+      bases_(1, 0),
+      factor_bases_(1, 0) {
+  if (max_states == 0) return;
+  for (size_t c = 0; c < components.num_components; ++c) {
+    if (!components.has_query[c]) continue;
+    const size_t *begin = &components.vids[components.component_base[c]];
+    const size_t *end = begin + components.size_of(c);
+
+    // count the joint assignments to the query variables up to max_states
+    size_t num_states = 1;
+    for (const size_t *vid = begin; vid != end && num_states <= max_states;
+         ++vid) {
+      const Variable &variable = fg.variables[*vid];
+      if (!variable.is_evid) num_states *= variable.cardinality;
+    }
+    if (num_states > max_states) continue;
+    is_exact[c] = true;
+
+    // keep the query variables and the factors adjacent to them, as the rest
+    // only touch evidence
+    size_t factor_base = factor_ids_.size();
+    for (const size_t *vid = begin; vid != end; ++vid) {
+      const Variable &variable = fg.variables[*vid];
+      if (variable.is_evid) continue;
+      vids_.push_back(*vid);
+      for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+        const VariableToFactor &var_value =
+            fg.values[variable.var_val_base + k];
+        factor_ids_.insert(
+            factor_ids_.end(), &fg.factor_index[var_value.factor_index_base],
+            &fg.factor_index[var_value.factor_index_base +
+                             var_value.factor_index_length]);
+      }
+    }
+    std::sort(factor_ids_.begin() + factor_base, factor_ids_.end());
+    factor_ids_.erase(
+        std::unique(factor_ids_.begin() + factor_base, factor_ids_.end()),
+        factor_ids_.end());
+    bases_.push_back(vids_.size());
+    factor_bases_.push_back(factor_ids_.size());
+  }
+}
+
+void ExactInference::compute_marginals(InferenceResult &infrs,
+                                       size_t n_threads) const {
+  if (num_components() == 0) return;
+
+  // every thread enumerates different variables of the same assignments
+  std::unique_ptr<size_t[]> assignments(new size_t[infrs.nvars]);
+  COPY_ARRAY(infrs.assignments_evid.get(), infrs.nvars, assignments.get());
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(std::thread([this, &infrs, &assignments, &next]() {
+      for (size_t i; (i = next++) < num_components();)
+        compute_marginals_of(i, infrs, assignments.get());
+    }));
+  }
+  for (auto &t : threads) t.join();
+}
+
+void ExactInference::compute_marginals_of(size_t i, InferenceResult &infrs,
+                                          size_t assignments[]) const {
+  const size_t *vids = &vids_[bases_[i]];
+  const size_t num_vids = bases_[i + 1] - bases_[i];
+
+  // moves to the next joint assignment like an odometer, or returns false
+  // after the last one, which wraps around to all zeros
+  const auto next_assignment = [this, vids, num_vids, assignments]() {
+    for (size_t k = 0; k < num_vids; ++k) {
+      size_t &value = assignments[vids[k]];
+      if (++value < fg_.variables[vids[k]].cardinality) return true;
+      value = 0;
+    }
+    return false;
+  };
+
+  // log potential of every joint assignment
+  std::vector<double> log_potentials;
+  for (size_t k = 0; k < num_vids; ++k) assignments[vids[k]] = 0;
+  do {
+    double pot = 0;
+    for (size_t j = factor_bases_[i]; j < factor_bases_[i + 1]; ++j) {
+      const Factor &factor = fg_.factors[factor_ids_[j]];
+      pot += infrs.weight_values[factor.weight_id] *
+             factor.potential(fg_.vifs.get(), assignments);
+    }
+    log_potentials.push_back(pot);
+  } while (next_assignment());
+  double max = *std::max_element(log_potentials.begin(), log_potentials.end());
+  double sum = 0;
+  for (double pot : log_potentials) sum += exp(pot - max);
+  double log_z = max + log(sum);
+
+  // store as if each variable was sampled once with fractional tallies
+  for (size_t k = 0; k < num_vids; ++k) {
+    const Variable &variable = fg_.variables[vids[k]];
+    infrs.agg_nsamples[variable.id] = 1;
+    for (size_t v = 0; v < variable.internal_cardinality(); ++v)
+      infrs.sample_tallies[variable.var_val_base + v] = 0;
+  }
+  size_t state = 0;
+  do {
+    double prob = exp(log_potentials[state++] - log_z);
+    for (size_t k = 0; k < num_vids; ++k) {
+      const Variable &variable = fg_.variables[vids[k]];
+      size_t value = assignments[variable.id];
+      // a boolean var only tallies its true value
+      if (!variable.is_boolean() || value == 1)
+        infrs.sample_tallies[variable.var_val_base +
+                             variable.var_value_offset(value)] += prob;
+    }
+  } while (next_assignment());
+}
+
+}  // namespace dd
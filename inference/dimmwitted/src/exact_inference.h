@@ -0,0 +1,55 @@
+#ifndef DIMMWITTED_EXACT_INFERENCE_H_
+#define DIMMWITTED_EXACT_INFERENCE_H_
+
+#include "components.h"
+#include "factor_graph.h"
+#include "inference_result.h"
+
+#include <vector>
+
+namespace dd {
+
+/**
+ * Exact inference for the connected components whose query variables have a
+ * small enough joint state space, which is enumerated to compute their
+ * marginals given the evidence, so only the rest need to be sampled.
+ */
+class ExactInference {
+ public:
+  // whether each component is handled here
+  std::vector<bool> is_exact;
+
+  /**
+   * Picks the components with any query variable but at most max_states
+   * joint assignments to them.
+   */
+  ExactInference(const FactorGraph &fg, const ConnectedComponents &components,
+                 size_t max_states);
+
+  inline size_t num_components() const { return bases_.size() - 1; }
+
+  /**
+   * Computes the exact marginals of the query variables of the picked
+   * components into infrs as if each was sampled once with fractional
+   * tallies, given its weights and the evidence, using n_threads threads.
+   */
+  void compute_marginals(InferenceResult &infrs, size_t n_threads) const;
+
+ private:
+  const FactorGraph &fg_;
+  // query variables and factors of each picked component, where the ones of
+  // the i-th are at [bases_[i], bases_[i + 1]) and
+  // [factor_bases_[i], factor_bases_[i + 1]), respectively
+  std::vector<size_t> vids_;
+  std::vector<size_t> bases_;
+  std::vector<size_t> factor_ids_;
+  std::vector<size_t> factor_bases_;
+
+  // enumerates the joint assignments of the i-th picked component
+  void compute_marginals_of(size_t i, InferenceResult &infrs,
+                            size_t assignments[]) const;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_EXACT_INFERENCE_H_
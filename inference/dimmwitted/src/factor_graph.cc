@@ -5,6 +5,7 @@
 #include <iostream>
 #include <algorithm>
 #include <thread>
+#include <unordered_map>
 #include <unistd.h>
 
 namespace dd {
@@ -200,6 +201,379 @@ void FactorGraph::construct_index_part(size_t v_start, size_t v_end,
   }
 }
 
+// runs fn on (at most) num_threads contiguous ranges of [0, num) in parallel
+static void parallel_for_ranges(
+    size_t num, size_t num_threads,
+    const std::function<void(size_t, size_t)> &fn) {
+  const size_t increment = (num + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  for (size_t begin = 0; begin < num; begin += increment)
+    threads.push_back(std::thread(fn, begin, std::min(num, begin + increment)));
+  for (auto &t : threads) t.join();
+}
+
+size_t FactorGraph::deduplicate_factors() {
+  const size_t num_factors = size.num_factors;
+  // small graph, single thread
+  const size_t num_threads =
+      num_factors < 1000 ? 1 : sysconf(_SC_NPROCESSORS_CONF);
+
+  std::vector<size_t> hashes(num_factors);
+  auto hash_factors = [this, &hashes](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const Factor &factor = factors[i];
+      size_t hash = hash_combine(factor.func_id, factor.weight_id);
+      for (size_t j = 0; j < factor.num_vars; ++j) {
+        const FactorToVariable &vif = get_factor_vif_at(factor, j);
+        hash = hash_combine(hash_combine(hash, vif.vid), vif.dense_equal_to);
+      }
+      hashes[i] = hash;
+    }
+  };
+  parallel_for_ranges(num_factors, num_threads, hash_factors);
+
+  // each shard of hashes is merged on its own thread, as identical factors
+  // always share one, in id order, so every factor is merged into the first
+  std::vector<size_t> merged_into(num_factors, Factor::INVALID_ID);
+  auto is_same_vif = [](const FactorToVariable &a, const FactorToVariable &b) {
+    return a.vid == b.vid && a.dense_equal_to == b.dense_equal_to;
+  };
+  auto merge_shards = [&](size_t shard_begin, size_t shard_end) {
+    for (size_t shard = shard_begin; shard < shard_end; ++shard) {
+      std::unordered_map<size_t, std::vector<size_t>> firsts;
+      for (size_t i = 0; i < num_factors; ++i) {
+        if (hashes[i] % num_threads != shard) continue;
+        const Factor &factor = factors[i];
+        std::vector<size_t> &candidates = firsts[hashes[i]];
+        for (size_t first_id : candidates) {
+          Factor &first = factors[first_id];
+          if (first.func_id != factor.func_id ||
+              first.weight_id != factor.weight_id ||
+              first.num_vars != factor.num_vars ||
+              !std::equal(&vifs[factor.vif_base],
+                          &vifs[factor.vif_base + factor.num_vars],
+                          &vifs[first.vif_base], is_same_vif))
+            continue;
+          first.feature_value += factor.feature_value;
+          merged_into[i] = first_id;
+          break;
+        }
+        if (merged_into[i] == Factor::INVALID_ID) candidates.push_back(i);
+      }
+    }
+  };
+  parallel_for_ranges(num_threads, num_threads, merge_shards);
+
+  // renumber the factors left and move them with their vifs to arrays that
+  // fit them
+  std::vector<size_t> new_ids(num_factors, Factor::INVALID_ID);
+  size_t num_kept = 0, num_edges = 0;
+  for (size_t i = 0; i < num_factors; ++i) {
+    if (merged_into[i] != Factor::INVALID_ID) continue;
+    new_ids[i] = num_kept++;
+    num_edges += factors[i].num_vars;
+  }
+  if (num_kept == num_factors) return 0;
+  Factor *new_factors = fast_alloc_no_init<Factor>(num_kept);
+  FactorToVariable *new_vifs = fast_alloc_no_init<FactorToVariable>(num_edges);
+  size_t edge_id = 0;
+  for (size_t i = 0; i < num_factors; ++i) {
+    if (new_ids[i] == Factor::INVALID_ID) continue;
+    Factor &factor = new_factors[new_ids[i]];
+    factor = factors[i];
+    factor.id = new_ids[i];
+    std::copy(&vifs[factor.vif_base], &vifs[factor.vif_base + factor.num_vars],
+              &new_vifs[edge_id]);
+    factor.vif_base = edge_id;
+    edge_id += factor.num_vars;
+  }
+  fast_alloc_free(factors.release());
+  factors.reset(new_factors);
+  fast_alloc_free(vifs.release());
+  vifs.reset(new_vifs);
+  fast_alloc_free(factor_index.release());
+  factor_index.reset(fast_alloc_no_init<size_t>(num_edges));
+  size.num_factors = capacity.num_factors = num_kept;
+  size.num_edges = capacity.num_edges = num_edges;
+
+  // and point the variables to them, leaving the merged ones out
+  auto renumber_adjacent_factors = [this, &new_ids](size_t begin, size_t end) {
+    for (size_t vid = begin; vid < end; ++vid) {
+      auto &adjacent_factors = variables[vid].adjacent_factors;
+      if (!adjacent_factors) continue;
+      adjacent_factors->erase(
+          std::remove_if(adjacent_factors->begin(), adjacent_factors->end(),
+                         [&new_ids](const TempValueFactor &item) {
+                           return new_ids[item.factor_id] ==
+                                  Factor::INVALID_ID;
+                         }),
+          adjacent_factors->end());
+      for (auto &item : *adjacent_factors)
+        item.factor_id = new_ids[item.factor_id];
+    }
+  };
+  parallel_for_ranges(size.num_variables, num_threads,
+                      renumber_adjacent_factors);
+  return num_factors - num_kept;
+}
+
+void FactorGraph::reorder_by_locality() {
+  const size_t num_variables = size.num_variables;
+  const size_t num_factors = size.num_factors;
+  std::vector<size_t> &new_vids = reordered_vids;
+  new_vids.assign(num_variables, Variable::INVALID_ID);
+  original_vids.clear();
+  original_vids.reserve(num_variables);
+  std::vector<size_t> new_fids(num_factors, Factor::INVALID_ID);
+  std::vector<size_t> original_fids;
+  original_fids.reserve(num_factors);
+
+  // original_vids doubles as the queue of the breadth-first search
+  auto reach = [this, &new_vids](size_t vid) {
+    if (new_vids[vid] != Variable::INVALID_ID) return;
+    new_vids[vid] = original_vids.size();
+    original_vids.push_back(vid);
+  };
+  for (size_t root = 0; root < num_variables; ++root) {
+    if (new_vids[root] != Variable::INVALID_ID) continue;
+    reach(root);
+    for (size_t i = new_vids[root]; i < original_vids.size(); ++i) {
+      const Variable &variable = variables[original_vids[i]];
+      if (!variable.adjacent_factors) continue;
+      for (const auto &item : *variable.adjacent_factors) {
+        if (new_fids[item.factor_id] != Factor::INVALID_ID) continue;
+        new_fids[item.factor_id] = original_fids.size();
+        original_fids.push_back(item.factor_id);
+        const Factor &factor = factors[item.factor_id];
+        for (size_t j = 0; j < factor.num_vars; ++j)
+          reach(get_factor_vif_at(factor, j).vid);
+      }
+    }
+  }
+  // factors without any variable go last
+  for (size_t fid = 0; fid < num_factors; ++fid) {
+    if (new_fids[fid] != Factor::INVALID_ID) continue;
+    new_fids[fid] = original_fids.size();
+    original_fids.push_back(fid);
+  }
+
+  // move the variables with their pointers, after nulling those of the new
+  // array as the constructor does
+  Variable *new_variables =
+      fast_alloc_no_init<Variable>(capacity.num_variables);
+  for (size_t i = 0; i < capacity.num_variables; ++i) {
+    new_variables[i].domain_map.release();
+    new_variables[i].adjacent_factors.release();
+  }
+  for (size_t vid = 0; vid < num_variables; ++vid) {
+    Variable &variable = new_variables[vid];
+    Variable &original = variables[original_vids[vid]];
+    auto domain_map = std::move(original.domain_map);
+    auto adjacent_factors = std::move(original.adjacent_factors);
+    variable = original;
+    variable.id = vid;
+    variable.domain_map = std::move(domain_map);
+    variable.adjacent_factors = std::move(adjacent_factors);
+    if (variable.adjacent_factors) {
+      for (auto &item : *variable.adjacent_factors)
+        item.factor_id = new_fids[item.factor_id];
+    }
+  }
+  fast_alloc_free(variables.release());
+  variables.reset(new_variables);
+
+  // and lay out the factors and their vifs in the new order
+  Factor *new_factors = fast_alloc_no_init<Factor>(capacity.num_factors);
+  FactorToVariable *new_vifs =
+      fast_alloc_no_init<FactorToVariable>(capacity.num_edges);
+  size_t edge_id = 0;
+  for (size_t fid = 0; fid < num_factors; ++fid) {
+    Factor &factor = new_factors[fid];
+    factor = factors[original_fids[fid]];
+    factor.id = fid;
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const FactorToVariable &vif = get_factor_vif_at(factor, j);
+      new_vifs[edge_id + j] =
+          FactorToVariable(new_vids[vif.vid], vif.dense_equal_to);
+    }
+    factor.vif_base = edge_id;
+    edge_id += factor.num_vars;
+  }
+  fast_alloc_free(factors.release());
+  factors.reset(new_factors);
+  fast_alloc_free(vifs.release());
+  vifs.reset(new_vifs);
+}
+
+bool FactorGraph::has_only_unary_factors() const {
+  for (size_t i = 0; i < size.num_factors; ++i) {
+    if (factors[i].num_vars != 1) return false;
+  }
+  return true;
+}
+
+bool FactorGraph::has_observed_markov_blanket(const Variable &variable) const {
+  for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+    const VariableToFactor &var_value = values[variable.var_val_base + k];
+    for (size_t i = 0; i < var_value.factor_index_length; ++i) {
+      const Factor &factor =
+          factors[factor_index[var_value.factor_index_base + i]];
+      for (size_t j = 0; j < factor.num_vars; ++j) {
+        size_t vid = get_factor_vif_at(factor, j).vid;
+        if (vid != variable.id && !variables[vid].is_evid) return false;
+      }
+    }
+  }
+  return true;
+}
+
+void FactorGraph::simplify_given_evidence(size_t &num_constant,
+                                          size_t &num_stripped) {
+  num_constant = 0;
+  num_stripped = 0;
+  std::vector<bool> is_constant(size.num_factors, false);
+  for (size_t factor_id = 0; factor_id < size.num_factors; ++factor_id) {
+    Factor &factor = factors[factor_id];
+    size_t num_query = 0;
+    bool has_satisfied = false;
+    bool has_unsatisfied = false;
+    bool has_unsatisfied_body = false;
+    bool has_satisfied_head = false;
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const FactorToVariable &vif = get_factor_vif_at(factor, j);
+      const Variable &variable = variables[vif.vid];
+      if (!variable.is_evid) {
+        ++num_query;
+        continue;
+      }
+      bool is_satisfied = vif.satisfiedUsing(variable.assignment_dense);
+      if (is_satisfied)
+        has_satisfied = true;
+      else
+        has_unsatisfied = true;
+      if (j + 1 < factor.num_vars)
+        has_unsatisfied_body |= !is_satisfied;
+      else
+        has_satisfied_head = is_satisfied;
+    }
+    // only factors of query variables matter in inference
+    if (num_query == 0 || num_query == factor.num_vars) continue;
+
+    // which evidence literals can go once the factor is not constant, where
+    // those of EQUAL all agree, so one of them is enough
+    bool is_head_kept = false;
+    bool is_one_kept = false;
+    switch (factor.func_id) {
+      case FUNC_AND:
+      case FUNC_ISTRUE:
+      case FUNC_AND_CATEGORICAL:
+        is_constant[factor_id] = has_unsatisfied;
+        break;
+      case FUNC_OR:
+        is_constant[factor_id] = has_satisfied;
+        break;
+      case FUNC_EQUAL:
+        is_constant[factor_id] = has_satisfied && has_unsatisfied;
+        is_one_kept = true;
+        break;
+      case FUNC_IMPLY_NATURAL:
+        is_constant[factor_id] = has_unsatisfied_body;
+        is_head_kept = true;
+        break;
+      case FUNC_IMPLY_MLN:
+        is_constant[factor_id] = has_unsatisfied_body || has_satisfied_head;
+        is_head_kept = true;
+        break;
+      default:
+        continue;
+    }
+    if (is_constant[factor_id]) {
+      ++num_constant;
+      continue;
+    }
+
+    // move the literals kept to the front of the factor's vifs
+    size_t num_kept = 0;
+    bool has_kept_evidence = false;
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const FactorToVariable &vif = get_factor_vif_at(factor, j);
+      bool is_kept = true;
+      if (variables[vif.vid].is_evid &&
+          !(is_head_kept && j + 1 == factor.num_vars)) {
+        is_kept = is_one_kept && !has_kept_evidence;
+        has_kept_evidence |= is_kept;
+      }
+      if (is_kept)
+        vifs[factor.vif_base + num_kept++] = vif;
+      else
+        ++num_stripped;
+    }
+    factor.num_vars = num_kept;
+  }
+
+  // drop the constant factors from the lists of the query variables
+  for (size_t vid = 0; vid < size.num_variables; ++vid) {
+    const Variable &variable = variables[vid];
+    if (variable.is_evid) continue;
+    for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+      VariableToFactor &var_value = values[variable.var_val_base + k];
+      size_t *begin = &factor_index[var_value.factor_index_base];
+      var_value.factor_index_length =
+          std::remove_if(begin, begin + var_value.factor_index_length,
+                         [&is_constant](size_t factor_id) {
+                           return is_constant[factor_id];
+                         }) -
+          begin;
+    }
+  }
+}
+
+size_t FactorGraph::fold_unary_factors(const double weight_values[]) {
+  if (unary_bias_base.empty()) {
+    unary_bias_base.resize(size.num_variables + 1, 0);
+    for (size_t vid = 0; vid < size.num_variables; ++vid)
+      unary_bias_base[vid + 1] =
+          unary_bias_base[vid] + variables[vid].cardinality;
+
+    // take the factors left with only the variable itself out of its lists,
+    // e.g., those whose other variables were evidence simplified away
+    for (size_t vid = 0; vid < size.num_variables; ++vid) {
+      const Variable &variable = variables[vid];
+      for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+        VariableToFactor &var_value = values[variable.var_val_base + k];
+        size_t *begin = &factor_index[var_value.factor_index_base];
+        var_value.factor_index_length =
+            std::remove_if(begin, begin + var_value.factor_index_length,
+                           [this, vid, k](size_t factor_id) {
+                             const Factor &factor = factors[factor_id];
+                             if (factor.num_vars != 1 ||
+                                 vifs[factor.vif_base].vid != vid)
+                               return false;
+                             folded_factors.push_back({k, factor_id});
+                             return true;
+                           }) -
+            begin;
+      }
+    }
+  }
+
+  // sum them up for every value whose potential traverses the list each came
+  // from, i.e., both values of a boolean variable
+  unary_bias.assign(unary_bias_base.back(), 0.0);
+  for (const auto &folded : folded_factors) {
+    const Factor &factor = factors[folded.second];
+    const Variable &variable = variables[vifs[factor.vif_base].vid];
+    double *bias = &unary_bias[unary_bias_base[variable.id]];
+    for (size_t value = 0; value < variable.cardinality; ++value) {
+      if (variable.var_value_offset(value) != folded.first) continue;
+      // no assignments needed as the factor only sees the proposal
+      bias[value] += weight_values[factor.weight_id] *
+                     factor.potential(vifs.get(), nullptr, variable.id, value);
+    }
+  }
+  return folded_factors.size();
+}
+
 void FactorGraph::safety_check() {
   // check if any space is wasted
   assert(capacity.num_variables == size.num_variables);
@@ -231,6 +605,11 @@ FactorGraph::FactorGraph(const FactorGraph &other)
   parallel_copy<Variable>(other.variables, variables, size.num_variables);
   parallel_copy<size_t>(other.factor_index, factor_index, size.num_edges);
   parallel_copy<VariableToFactor>(other.values, values, size.num_values);
+  unary_bias = other.unary_bias;
+  unary_bias_base = other.unary_bias_base;
+  folded_factors = other.folded_factors;
+  original_vids = other.original_vids;
+  reordered_vids = other.reordered_vids;
 
   // slow copy: 18 sec for a 270M-factor graph
   // COPY_ARRAY_UNIQUE_PTR_MEMBER(variables, size.num_variables);
@@ -261,6 +640,26 @@ inline void FactorGraph::sgd_on_factor(size_t factor_id, double stepsize,
   infrs.update_weight(factor.weight_id, stepsize, gradient);
 }
 
+void FactorGraph::sgd_on_factors(size_t f_start, size_t f_end,
+                                 InferenceResult &infrs, double stepsize,
+                                 bool learn_non_evidence, bool is_noise_aware) {
+  for (size_t factor_id = f_start; factor_id < f_end; ++factor_id) {
+    const Factor &factor = factors[factor_id];
+    // only factors touching a variable we learn from contribute a gradient,
+    // which is the same set sgd_on_variable would reach
+    bool is_learnable = learn_non_evidence;
+    for (size_t i = 0; !is_learnable && i < factor.num_vars; ++i) {
+      const Variable &variable = variables[get_factor_vif_at(factor, i).vid];
+      is_learnable = is_noise_aware ? variable.has_truthiness()
+                                    : variable.is_evid;
+    }
+    if (!is_learnable) continue;
+    // without a proposal, the evid chain already holds the evidence values
+    sgd_on_factor(factor_id, stepsize, Variable::INVALID_ID,
+                  Variable::INVALID_VALUE, infrs);
+  }
+}
+
 void FactorGraph::sgd_on_variable(const Variable &variable,
                                   InferenceResult &infrs, double stepsize,
                                   bool is_noise_aware) {
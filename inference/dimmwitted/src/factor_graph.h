@@ -69,7 +69,22 @@ class FactorGraph {
   std::unique_ptr<size_t[]> factor_index;
   std::unique_ptr<VariableToFactor[]> values;
 
+  // summed weighted potential of the unary factors folded out of the
+  // factor_index lists (see fold_unary_factors) for each value of each
+  // variable starting at unary_bias_base[vid], and those factors' ids with
+  // the offset of the list each came from; all empty until folded
+  std::vector<double> unary_bias;
+  std::vector<size_t> unary_bias_base;
+  std::vector<std::pair<size_t, size_t>> folded_factors;
+
+  // original id of each variable, and the id of each original one, after
+  // reorder_by_locality; both empty when the ids are the original ones
+  std::vector<size_t> original_vids;
+  std::vector<size_t> reordered_vids;
+
   void load_weights(const std::vector<std::string>& filenames);
+  // overwrites the values of weights already loaded, e.g., with learned ones
+  void load_weight_values(const std::vector<std::string>& filenames);
   void load_variables(const std::vector<std::string>& filenames);
   void load_factors(const std::vector<std::string>& filenames);
   void load_domains(const std::vector<std::string>& filenames);
@@ -82,6 +97,54 @@ class FactorGraph {
   void construct_index_part(size_t v_start, size_t v_end, size_t val_base,
                             size_t fac_base);
 
+  // merges every factor into the first one with the same function, vifs, and
+  // weight, adding up their feature values, which keeps the potentials and
+  // gradients the same since they scale with it, and renumbers the factors
+  // left, shrinking the arrays to fit them; to be done before
+  // construct_index, and returns the number of factors merged away
+  size_t deduplicate_factors();
+
+  // renumbers the variables in breadth-first order over the factors from
+  // each one not reached yet, and the factors in the order they are first
+  // reached, so neighbors sit close together in memory, keeping the original
+  // ids in original_vids for input/output; to be done before construct_index
+  void reorder_by_locality();
+
+  inline size_t original_vid(size_t vid) const {
+    return original_vids.empty() ? vid : original_vids[vid];
+  }
+
+  inline size_t reordered_vid(size_t original_vid) const {
+    return reordered_vids.empty() ? original_vid : reordered_vids[original_vid];
+  }
+
+  // whether every factor touches a single variable, i.e., all variables are
+  // independent and learning/inference reduce to (multinomial) logistic
+  // regression
+  bool has_only_unary_factors() const;
+
+  // whether all other variables in the factors adjacent to the given one are
+  // evidence, i.e., its conditional is fixed unless evidence gets sampled
+  bool has_observed_markov_blanket(const Variable& variable) const;
+
+  // specializes the factors of query variables to the values of the evidence
+  // for inference (unless evidence gets sampled): drops the factors made
+  // constant, e.g., an AND with a false evidence literal, from the
+  // factor_index lists of the query variables, and the evidence literals that
+  // no longer matter, e.g., the true ones of an AND, from the rest, counting
+  // both into num_constant and num_stripped.  The potentials stay the same
+  // for every assignment agreeing with the evidence, but learning, which
+  // needs them all, must be done by then.
+  void simplify_given_evidence(size_t& num_constant, size_t& num_stripped);
+
+  // moves the factors of a single variable out of the factor_index lists into
+  // unary_bias, weighted by the given weight values, so potential looks up
+  // their sum for each proposal instead of evaluating them one by one, and
+  // returns the number of factors folded.  Calling it again only recomputes
+  // unary_bias, e.g., after the weights change.  Like the simplification
+  // above, it is for inference, as learning needs every factor in the lists.
+  size_t fold_unary_factors(const double weight_values[]);
+
   inline size_t get_var_value_at(const Variable& var, size_t idx) const {
     return values[var.var_val_base + idx].value;
   }
@@ -115,6 +178,17 @@ class FactorGraph {
   inline void sgd_on_factor(size_t factor_id, double stepsize, size_t vid,
                             size_t evidence_value, InferenceResult& infrs);
 
+  /**
+   * Updates the weights of factors with ids in [f_start, f_end) exactly once
+   * each, using the current assignments of both chains.
+   * Used by the factor-centric learning sweep (see SWEEP_FACTOR), after all
+   * variables have been sampled, so factors are streamed in storage order
+   * instead of being revisited through each adjacent variable.
+   */
+  void sgd_on_factors(size_t f_start, size_t f_end, InferenceResult& infrs,
+                      double stepsize, bool learn_non_evidence,
+                      bool is_noise_aware);
+
   /**
    * Returns log-linear weighted potential of the all factors for the given
    * variable using the propsal value.
@@ -127,7 +201,9 @@ class FactorGraph {
 inline double FactorGraph::potential(const Variable& variable, size_t proposal,
                                      const size_t assignments[],
                                      const double weight_values[]) {
-  double pot = 0.0;
+  double pot = unary_bias.empty()
+                   ? 0.0
+                   : unary_bias[unary_bias_base[variable.id] + proposal];
 
   VariableToFactor* const var_value_base = &values[variable.var_val_base];
   size_t offset = variable.var_value_offset(proposal);
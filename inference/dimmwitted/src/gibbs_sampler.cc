@@ -2,6 +2,10 @@
 
 namespace dd {
 
+// To placate linker error "undefined reference" (see variable.cc)
+constexpr size_t GibbsSamplerThread::SUBSAMPLE_BLOCK_SIZE;
+constexpr size_t GibbsSamplerThread::MAX_SCAN_RATE;
+
 GibbsSampler::GibbsSampler(std::unique_ptr<FactorGraph> _pfg,
                            const Weight weights[], const NumaNodes &numa_nodes,
                            size_t nthread, size_t nodeid, const CmdParser &opts)
@@ -17,10 +21,22 @@ GibbsSampler::GibbsSampler(std::unique_ptr<FactorGraph> _pfg,
     workers.push_back(GibbsSamplerThread(fg, infrs, i, nthread, opts));
 }
 
-void GibbsSampler::sample(size_t i_epoch) {
+void GibbsSampler::sample(size_t i_epoch, bool should_tally) {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(std::thread(
+        [&worker, should_tally]() { worker.sample(should_tally); }));
+  }
+}
+
+void GibbsSampler::anneal(double inverse_temperature, bool is_icm,
+                          std::atomic<size_t> &num_changed) {
   numa_nodes_.bind();
   for (auto &worker : workers) {
-    threads.push_back(std::thread([&worker]() { worker.sample(); }));
+    threads.push_back(
+        std::thread([&worker, inverse_temperature, is_icm, &num_changed]() {
+          num_changed += worker.anneal(inverse_temperature, is_icm);
+        }));
   }
 }
 
@@ -32,6 +48,72 @@ void GibbsSampler::sample_sgd(double stepsize) {
   }
 }
 
+void GibbsSampler::sample_chains() {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(std::thread([&worker]() { worker.sample_chains(); }));
+  }
+}
+
+void GibbsSampler::sgd_on_factors(double stepsize) {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(std::thread(
+        [&worker, stepsize]() { worker.sgd_on_factors(stepsize); }));
+  }
+}
+
+void GibbsSampler::pseudo_likelihood_sgd(double stepsize) {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(std::thread(
+        [&worker, stepsize]() { worker.pseudo_likelihood_sgd(stepsize); }));
+  }
+}
+
+void GibbsSampler::compute_marginals() {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(std::thread([&worker]() { worker.compute_marginals(); }));
+  }
+}
+
+void GibbsSampler::compute_observed_marginals() {
+  numa_nodes_.bind();
+  for (auto &worker : workers) {
+    threads.push_back(
+        std::thread([&worker]() { worker.compute_observed_marginals(); }));
+  }
+}
+
+void GibbsSampler::schedule_inference(const std::vector<size_t> &vids) {
+  size_t chunk = vids.size() / workers.size() + 1;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    size_t begin = std::min(vids.size(), chunk * i);
+    size_t end = std::min(vids.size(), chunk * (i + 1));
+    workers[i].set_inference_variables(vids.data() + begin, end - begin);
+  }
+}
+
+void GibbsSampler::schedule_chains(const ChainSampler &chains) {
+  size_t num_vids = 0;
+  for (size_t chain = 0; chain < chains.num_chains(); ++chain)
+    num_vids += chains.size_of(chain);
+  size_t chain = 0;
+  size_t num_scheduled = 0;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    size_t begin = chain;
+    size_t quota = num_vids * (i + 1) / workers.size();
+    while (chain < chains.num_chains() && num_scheduled < quota)
+      num_scheduled += chains.size_of(chain++);
+    workers[i].set_inference_chains(&chains, begin, chain);
+  }
+}
+
+void GibbsSampler::set_temperature(double temperature) {
+  for (auto &worker : workers) worker.set_temperature(temperature);
+}
+
 void GibbsSampler::wait() {
   for (auto &t : threads) t.join();
   threads.clear();
@@ -41,17 +123,65 @@ GibbsSamplerThread::GibbsSamplerThread(FactorGraph &fg, InferenceResult &infrs,
                                        size_t ith_shard, size_t n_shards,
                                        const CmdParser &opts)
     : varlen_potential_buffer_(0),
+      chains_(nullptr),
+      chain_begin_(0),
+      chain_end_(0),
+      min_scan_rate(opts.min_scan_rate),
       fg(fg),
       infrs(infrs),
       sample_evidence(opts.should_sample_evidence),
       learn_non_evidence(opts.should_learn_non_evidence),
-      is_noise_aware(opts.is_noise_aware) {
+      is_noise_aware(opts.is_noise_aware),
+      learning_fraction(opts.learning_fraction),
+      stratify_evidence(opts.should_stratify_evidence),
+      rao_blackwellize(opts.should_rao_blackwellize),
+      skip_observed(!opts.should_force_gibbs && !opts.should_sample_evidence &&
+                    !opts.should_sample_observed),
+      inverse_temperature(1) {
   set_random_seed(rand(), rand(), rand());
   size_t nvar = fg.size.num_variables;
   // calculates the start and end id in this partition
   start = ((size_t)(nvar / n_shards) + 1) * ith_shard;
   end = ((size_t)(nvar / n_shards) + 1) * (ith_shard + 1);
   end = end > nvar ? nvar : end;
+  // same for factors
+  size_t nfactor = fg.size.num_factors;
+  factor_start = ((size_t)(nfactor / n_shards) + 1) * ith_shard;
+  factor_end = ((size_t)(nfactor / n_shards) + 1) * (ith_shard + 1);
+  factor_end = factor_end > nfactor ? nfactor : factor_end;
+
+  // find variables whose conditionals stay the same throughout inference
+  is_sampling_range_ = true;
+  if (skip_observed) {
+    for (size_t vid = start; vid < end; ++vid) add_inference_variable(vid);
+    // just sample the range if none is skipped
+    is_sampling_range_ = observed_vids_.empty();
+    if (is_sampling_range_) sampled_vids_.clear();
+  }
+}
+
+void GibbsSamplerThread::add_inference_variable(size_t vid) {
+  const Variable &variable = fg.variables[vid];
+  if (skip_observed && !variable.is_evid &&
+      fg.has_observed_markov_blanket(variable))
+    observed_vids_.push_back(vid);
+  else
+    sampled_vids_.push_back(vid);
+}
+
+void GibbsSamplerThread::set_inference_variables(const size_t vids[],
+                                                 size_t num_vids) {
+  observed_vids_.clear();
+  sampled_vids_.clear();
+  for (size_t i = 0; i < num_vids; ++i) add_inference_variable(vids[i]);
+  is_sampling_range_ = false;
+}
+
+void GibbsSamplerThread::set_inference_chains(const ChainSampler *chains,
+                                              size_t begin, size_t end) {
+  chains_ = chains;
+  chain_begin_ = begin;
+  chain_end_ = end;
 }
 
 void GibbsSamplerThread::set_random_seed(unsigned short seed0,
@@ -62,16 +192,113 @@ void GibbsSamplerThread::set_random_seed(unsigned short seed0,
   p_rand_seed[2] = seed2;
 }
 
-void GibbsSamplerThread::sample() {
+void GibbsSamplerThread::sample(bool should_tally) {
+  if (min_scan_rate > 0) {
+    sample_adaptively(should_tally);
+  } else if (is_sampling_range_) {
+    for (size_t vid = start; vid < end; ++vid) {
+      sample_single_variable(vid, should_tally);
+    }
+  } else {
+    for (size_t vid : sampled_vids_) sample_single_variable(vid, should_tally);
+  }
+  for (size_t chain = chain_begin_; chain < chain_end_; ++chain) {
+    chains_->sample(chain, fg, infrs, p_rand_seed, should_tally,
+                    chain_buffer_, inverse_temperature);
+  }
+}
+
+void GibbsSamplerThread::sample_adaptively(bool should_tally) {
+  const size_t num_vids =
+      is_sampling_range_ ? end - start : sampled_vids_.size();
+  if (scan_stats_.size() != num_vids) {
+    // every variable starts as if it flipped once, until shown otherwise
+    scan_stats_.resize(num_vids);
+    for (auto &stats : scan_stats_)
+      stats = {1, 1, 1, erand48(p_rand_seed)};
+  }
+
+  // rates relative to the average flip rate of the variables sampled, which
+  // change less and less as the flip rates settle, so the chain still
+  // converges to the same distribution
+  double sum_flip_rates = 0;
+  size_t num_sampled = 0;
+  for (size_t i = 0; i < num_vids; ++i) {
+    size_t vid = is_sampling_range_ ? start + i : sampled_vids_[i];
+    if (fg.variables[vid].is_evid && !sample_evidence) continue;
+    sum_flip_rates += scan_stats_[i].flip_rate;
+    ++num_sampled;
+  }
+  const double mean_flip_rate =
+      num_sampled > 0 ? sum_flip_rates / num_sampled : 0;
+  for (auto &stats : scan_stats_) {
+    stats.scan_rate =
+        mean_flip_rate > 0
+            ? std::min((double)MAX_SCAN_RATE,
+                       std::max(min_scan_rate,
+                                stats.flip_rate / mean_flip_rate))
+            : 1;
+  }
+
+  // systematic visits spread over the passes, so the repeated ones of a
+  // variable are between updates of its neighbors
+  size_t *assignments = infrs.assignments_evid.get();
+  for (size_t pass = 0; pass < MAX_SCAN_RATE; ++pass) {
+    for (size_t i = 0; i < num_vids; ++i) {
+      ScanStats &stats = scan_stats_[i];
+      stats.credit += stats.scan_rate / MAX_SCAN_RATE;
+      if (stats.credit < 1) continue;
+      stats.credit -= 1;
+      size_t vid = is_sampling_range_ ? start + i : sampled_vids_[i];
+      size_t prev = assignments[vid];
+      sample_single_variable(vid, should_tally);
+      ++stats.num_updates;
+      stats.flip_rate += ((assignments[vid] != prev ? 1 : 0) -
+                          stats.flip_rate) / stats.num_updates;
+    }
+  }
+}
+
+size_t GibbsSamplerThread::anneal(double inverse_temperature, bool is_icm) {
+  size_t num_changed = 0;
   for (size_t vid = start; vid < end; ++vid) {
-    sample_single_variable(vid);
+    if (anneal_single_variable(vid, inverse_temperature, is_icm))
+      ++num_changed;
   }
+  return num_changed;
 }
 
 void GibbsSamplerThread::sample_sgd(double stepsize) {
-  for (size_t vid = start; vid < end; ++vid) {
+  for_each_learning_variable([this, stepsize](size_t vid) {
     sample_sgd_single_variable(vid, stepsize);
+  });
+}
+
+void GibbsSamplerThread::pseudo_likelihood_sgd(double stepsize) {
+  for_each_learning_variable([this, stepsize](size_t vid) {
+    pseudo_likelihood_sgd_single_variable(vid, stepsize);
+  });
+}
+
+void GibbsSamplerThread::compute_marginals() {
+  for (size_t vid = start; vid < end; ++vid) {
+    compute_marginal_single_variable(vid);
   }
 }
 
+void GibbsSamplerThread::compute_observed_marginals() {
+  for (size_t vid : observed_vids_) compute_marginal_single_variable(vid);
+}
+
+void GibbsSamplerThread::sample_chains() {
+  for (size_t vid = start; vid < end; ++vid) {
+    sample_chains_single_variable(vid);
+  }
+}
+
+void GibbsSamplerThread::sgd_on_factors(double stepsize) {
+  fg.sgd_on_factors(factor_start, factor_end, infrs, stepsize,
+                    learn_non_evidence, is_noise_aware);
+}
+
 }  // namespace dd
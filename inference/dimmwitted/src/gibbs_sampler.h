@@ -1,10 +1,14 @@
 #ifndef DIMMWITTED_GIBBS_SAMPLER_H_
 #define DIMMWITTED_GIBBS_SAMPLER_H_
 
+#include "chain_sampler.h"
 #include "common.h"
 #include "factor_graph.h"
 #include "numa_nodes.h"
 #include "timer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <stdlib.h>
 #include <thread>
 
@@ -41,15 +45,74 @@ class GibbsSampler {
                const CmdParser &opts);
 
   /**
-   * Performs sample
+   * Performs sample, tallying the samples for the marginals unless burning in
    */
-  void sample(size_t i_epoch);
+  void sample(size_t i_epoch, bool should_tally = true);
+
+  /**
+   * Anneals the evid chain at the given inverse temperature, or greedily if
+   * is_icm, adding the number of variables changed to num_changed (see
+   * GibbsSamplerThread::anneal)
+   */
+  void anneal(double inverse_temperature, bool is_icm,
+              std::atomic<size_t> &num_changed);
 
   /**
    * Performs SGD
    */
   void sample_sgd(double stepsize);
 
+  /**
+   * Samples both chains without updating weights (first half of a
+   * factor-centric learning epoch)
+   */
+  void sample_chains();
+
+  /**
+   * Updates weights with one pass over the factors (second half of a
+   * factor-centric learning epoch)
+   */
+  void sgd_on_factors(double stepsize);
+
+  /**
+   * Performs SGD on the pseudo-likelihood of evidence
+   */
+  void pseudo_likelihood_sgd(double stepsize);
+
+  /**
+   * Computes exact marginals instead of sampling (see
+   * GibbsSamplerThread::compute_marginals)
+   */
+  void compute_marginals();
+
+  /**
+   * Computes exact marginals of the variables sample() skips (see
+   * GibbsSamplerThread::compute_observed_marginals)
+   */
+  void compute_observed_marginals();
+
+  /**
+   * Splits the given variables into equal contiguous chunks, one for each
+   * worker to sample in inference instead of its shard, e.g., so whole
+   * connected components stay on the same thread (see
+   * GibbsSamplerThread::set_inference_variables)
+   */
+  void schedule_inference(const std::vector<size_t> &vids);
+
+  /**
+   * Splits the chains of the given blocked sampler into contiguous ranges
+   * with about the same number of variables, one for each worker to sample
+   * jointly in inference besides its variables (see
+   * GibbsSamplerThread::set_inference_chains)
+   */
+  void schedule_chains(const ChainSampler &chains);
+
+  /**
+   * Makes sample() draw from the distribution with all potentials divided by
+   * the given temperature, e.g., for parallel tempering
+   */
+  void set_temperature(double temperature);
+
   /**
    * Waits for sample worker to finish
    */
@@ -63,6 +126,8 @@ class GibbsSamplerThread {
  private:
   // shard and variable id range assigned to this one
   size_t start, end;
+  // factor id range assigned to this one
+  size_t factor_start, factor_end;
 
   // RNG seed
   unsigned short p_rand_seed[3];
@@ -70,12 +135,65 @@ class GibbsSamplerThread {
   // potential for each proposals for categorical
   std::vector<double> varlen_potential_buffer_;
 
+  // query variables in this shard whose Markov blanket is all evidence, whose
+  // marginals are computed exactly instead of sampled, and the rest to sample
+  // in inference (unless is_sampling_range_, i.e., all in [start, end))
+  std::vector<size_t> observed_vids_;
+  std::vector<size_t> sampled_vids_;
+  bool is_sampling_range_;
+
+  // adds vid to either observed_vids_ or sampled_vids_
+  void add_inference_variable(size_t vid);
+
+  // chains to sample jointly in inference, [chain_begin_, chain_end_) of
+  // chains_ (if any), and the scratch space for it
+  const ChainSampler *chains_;
+  size_t chain_begin_, chain_end_;
+  std::vector<double> chain_buffer_;
+
+  // running statistics of each variable sample() visits in adaptive-scan
+  // inference, in the order of sampled_vids_ (or [start, end)), where
+  // flip_rate is the fraction of its updates that changed its value so far,
+  // scan_rate the number of visits it gets per epoch, and credit the part of
+  // a visit carried over to the next pass
+  struct ScanStats {
+    double flip_rate;
+    size_t num_updates;
+    double scan_rate;
+    double credit;
+  };
+  std::vector<ScanStats> scan_stats_;
+  double min_scan_rate;
+
+  // max visits per epoch of a variable in adaptive-scan inference, i.e., the
+  // number of passes over the variables
+  static constexpr size_t MAX_SCAN_RATE = 4;
+
+  // samples the variables like sample(), but visiting each at its scan_rate
+  void sample_adaptively(bool should_tally);
+
   // references and cached flags
   FactorGraph &fg;
   InferenceResult &infrs;
   bool sample_evidence;
   bool learn_non_evidence;
   bool is_noise_aware;
+  double learning_fraction;
+  bool stratify_evidence;
+  bool rao_blackwellize;
+  // whether query variables with an all-evidence Markov blanket are skipped
+  bool skip_observed;
+
+  // the potentials are multiplied by this when drawing samples
+  double inverse_temperature;
+
+  // number of contiguous variables subsampled together in learning
+  static constexpr size_t SUBSAMPLE_BLOCK_SIZE = 64;
+
+  // calls fn with each variable id in this shard to visit in a learning
+  // epoch, which is a learning_fraction subsample of the shard
+  template <typename F>
+  inline void for_each_learning_variable(F fn);
 
  public:
   /**
@@ -89,8 +207,20 @@ class GibbsSamplerThread {
    * partitions
    * based on their ids. This function samples variables in the i_sharding-th
    * partition.
+   * With --adaptive_scan, variables whose values flip often are visited more
+   * than once and the settled ones only once in a few epochs, in proportion
+   * to their running flip rates, so the tallies of each are the average of
+   * its own updates.
+   */
+  void sample(bool should_tally = true);
+
+  /**
+   * Samples the variables in this shard at the given inverse temperature
+   * without tallying, or sets each to its most likely value given the rest if
+   * is_icm (iterated conditional modes), and returns the number of variables
+   * whose value changed.
    */
-  void sample();
+  size_t anneal(double inverse_temperature, bool is_icm);
 
   /**
    * Performs SGD with by sampling variables.  The variables are divided into
@@ -100,19 +230,105 @@ class GibbsSamplerThread {
    */
   void sample_sgd(double stepsize);
 
+  /**
+   * Samples both the free and evid chains for variables in this shard
+   * without touching the weights.
+   */
+  void sample_chains();
+
+  /**
+   * Performs SGD over the factors in this shard, each visited once, using the
+   * chains left by sample_chains().
+   */
+  void sgd_on_factors(double stepsize);
+
+  /**
+   * Performs SGD on the pseudo-likelihood of the evidence variables in this
+   * shard. No chain is sampled: each variable's conditional is computed
+   * exactly given the current values of its neighbors.
+   */
+  void pseudo_likelihood_sgd(double stepsize);
+
+  /**
+   * Computes the exact marginals of variables in this shard from their
+   * conditionals given the evid chain. Only valid when the conditionals do
+   * not depend on other sampled variables, e.g., when all factors are unary.
+   */
+  void compute_marginals();
+
+  /**
+   * Computes the exact marginals of the query variables in this shard whose
+   * neighbors are all evidence, which sample() skips as their conditionals
+   * never change.
+   */
+  void compute_observed_marginals();
+
+  /**
+   * Makes sample() visit the given variables in order instead of this shard
+   * (still skipping those compute_observed_marginals() takes care of).
+   */
+  void set_inference_variables(const size_t vids[], size_t num_vids);
+
+  /**
+   * Makes sample() also resample the chains [begin, end) of the given blocked
+   * sampler, each jointly.
+   */
+  void set_inference_chains(const ChainSampler *chains, size_t begin,
+                            size_t end);
+
+  /**
+   * Makes draw_sample() divide all potentials by the given temperature
+   */
+  inline void set_temperature(double temperature) {
+    inverse_temperature = 1 / temperature;
+  }
+
+  /**
+   * Computes the exact marginal of a single variable with id vid
+   */
+  inline void compute_marginal_single_variable(size_t vid);
+
+  /**
+   * Performs SGD on the pseudo-likelihood of a single variable with id vid
+   */
+  inline void pseudo_likelihood_sgd_single_variable(size_t vid,
+                                                    double stepsize);
+
   /**
    * Performs SGD by sampling a single variable with id vid
    */
   inline void sample_sgd_single_variable(size_t vid, double stepsize);
 
   /**
-   * Samples a single variable with id vid
+   * Samples both chains for a single variable with id vid
    */
-  inline void sample_single_variable(size_t vid);
+  inline void sample_chains_single_variable(size_t vid);
+
+  /**
+   * Samples a single variable with id vid, and tallies the sample for its
+   * marginal if should_tally
+   */
+  inline void sample_single_variable(size_t vid, bool should_tally = true);
+
+  /**
+   * Anneals a single variable with id vid (see anneal), and returns whether
+   * its value changed
+   */
+  inline bool anneal_single_variable(size_t vid, double inverse_temperature,
+                                     bool is_icm);
 
   // sample an "evidence" variable (parallel Gibbs conditioned on evidence)
   inline size_t sample_evid(const Variable &variable);
 
+  // compute the conditional distribution of a variable given the others into
+  // varlen_potential_buffer_
+  inline void compute_conditional(const Variable &variable,
+                                  const size_t assignments[],
+                                  const double weight_values[]);
+
+  // draw a value from the conditional computed by compute_conditional
+  inline size_t draw_from_conditional(const Variable &variable);
+
   // sample a single variable (regular Gibbs)
   inline size_t draw_sample(const Variable &variable,
                             const size_t assignments[],
@@ -133,6 +349,108 @@ inline void GibbsSamplerThread::sample_sgd_single_variable(size_t vid,
 
   const Variable &variable = fg.variables[vid];
 
+  sample_chains_single_variable(vid);
+
+  if (!learn_non_evidence && ((!is_noise_aware && !variable.is_evid) ||
+                              (is_noise_aware && !variable.has_truthiness())))
+    return;
+
+  fg.sgd_on_variable(variable, infrs, stepsize, is_noise_aware);
+}
+
+template <typename F>
+inline void GibbsSamplerThread::for_each_learning_variable(F fn) {
+  if (learning_fraction >= 1) {
+    for (size_t vid = start; vid < end; ++vid) fn(vid);
+  } else if (!stratify_evidence) {
+    // systematic sampling of whole blocks from a random offset, so the chosen
+    // blocks are evenly spread over the shard and streamed in storage order
+    double acc = erand48(p_rand_seed);
+    for (size_t block = start; block < end; block += SUBSAMPLE_BLOCK_SIZE) {
+      acc += learning_fraction;
+      if (acc < 1) continue;
+      acc -= 1;
+      size_t block_end = std::min(block + SUBSAMPLE_BLOCK_SIZE, end);
+      for (size_t vid = block; vid < block_end; ++vid) fn(vid);
+    }
+  } else {
+    // systematic sampling of single variables within each stratum, so that
+    // evidence and non-evidence are both visited at exactly the fraction
+    double acc[2] = {erand48(p_rand_seed), erand48(p_rand_seed)};
+    for (size_t vid = start; vid < end; ++vid) {
+      double &acc_stratum = acc[fg.variables[vid].is_evid ? 1 : 0];
+      acc_stratum += learning_fraction;
+      if (acc_stratum < 1) continue;
+      acc_stratum -= 1;
+      fn(vid);
+    }
+  }
+}
+
+inline void GibbsSamplerThread::pseudo_likelihood_sgd_single_variable(
+    size_t vid, double stepsize) {
+  // gradient of the negative log pseudo-likelihood of a weight
+  // = E[f|MB] - f(D), where MB is the Markov blanket of the variable, D is its
+  // observed value, and E[] is the exact expectation under the conditional
+  // distribution of the variable given MB.
+
+  const Variable &variable = fg.variables[vid];
+  if (is_noise_aware ? !variable.has_truthiness() : !variable.is_evid) return;
+
+  // evidence variables hold their observed values in the evid chain
+  const size_t *assignments = infrs.assignments_evid.get();
+  compute_conditional(variable, assignments, infrs.weight_values.get());
+
+  // turn it into the coefficient each value's potential gets in the gradient,
+  // i.e., conditional probability minus observed probability of the value
+  for (size_t i = 0; i < variable.cardinality; ++i) {
+    double observed;
+    if (is_noise_aware) {
+      observed = fg.values[variable.var_val_base + i].truthiness /
+                 variable.total_truthiness;
+    } else {
+      observed = (i == variable.assignment_dense) ? 1 : 0;
+    }
+    varlen_potential_buffer_[i] -= observed;
+  }
+
+  // update weights of all factors adjacent to the variable
+  for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+    const VariableToFactor &vv = fg.values[variable.var_val_base + k];
+    for (size_t j = 0; j < vv.factor_index_length; ++j) {
+      const Factor &factor =
+          fg.factors[fg.factor_index[vv.factor_index_base + j]];
+      if (infrs.weights_isfixed[factor.weight_id]) continue;
+      double gradient = 0;
+      for (size_t i = 0; i < variable.cardinality; ++i) {
+        gradient += varlen_potential_buffer_[i] *
+                    factor.potential(fg.vifs.get(), assignments, vid, i);
+      }
+      infrs.update_weight(factor.weight_id, stepsize, gradient);
+    }
+  }
+}
+
+inline void GibbsSamplerThread::compute_marginal_single_variable(size_t vid) {
+  const Variable &variable = fg.variables[vid];
+  if (variable.is_evid && !sample_evidence) return;
+
+  compute_conditional(variable, infrs.assignments_evid.get(),
+                      infrs.weight_values.get());
+
+  // store as if the variable was sampled once with fractional tallies
+  infrs.agg_nsamples[variable.id] = 1;
+  for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+    // a boolean var only tallies its true value
+    size_t value = variable.is_boolean() ? 1 : k;
+    infrs.sample_tallies[variable.var_val_base + k] =
+        varlen_potential_buffer_[value];
+  }
+}
+
+inline void GibbsSamplerThread::sample_chains_single_variable(size_t vid) {
+  const Variable &variable = fg.variables[vid];
+
   // pick a value for the regular Gibbs chain
   size_t proposal = draw_sample(variable, infrs.assignments_free.get(),
                                 infrs.weight_values.get());
@@ -140,24 +458,36 @@ inline void GibbsSamplerThread::sample_sgd_single_variable(size_t vid,
 
   // pick a value for the (parallel) evid Gibbs chain
   infrs.assignments_evid[variable.id] = sample_evid(variable);
-
-  if (!learn_non_evidence && ((!is_noise_aware && !variable.is_evid) ||
-                              (is_noise_aware && !variable.has_truthiness())))
-    return;
-
-  fg.sgd_on_variable(variable, infrs, stepsize, is_noise_aware);
 }
 
-inline void GibbsSamplerThread::sample_single_variable(size_t vid) {
+inline void GibbsSamplerThread::sample_single_variable(size_t vid,
+                                                       bool should_tally) {
   // this function uses the same sampling technique as in
   // sample_sgd_single_variable
 
   const Variable &variable = fg.variables[vid];
 
   if (!variable.is_evid || sample_evidence) {
+    if (rao_blackwellize && should_tally) {
+      // draw from the conditional, and tally the conditional itself, whose
+      // average has lower variance than that of the samples
+      compute_conditional(variable, infrs.assignments_evid.get(),
+                          infrs.weight_values.get());
+      infrs.assignments_evid[variable.id] = draw_from_conditional(variable);
+      ++infrs.agg_nsamples[variable.id];
+      for (size_t i = variable.is_boolean() ? 1 : 0; i < variable.cardinality;
+           ++i) {
+        infrs.sample_tallies[variable.var_val_base +
+                             variable.var_value_offset(i)] +=
+            varlen_potential_buffer_[i];
+      }
+      return;
+    }
+
     size_t proposal = draw_sample(variable, infrs.assignments_evid.get(),
                                   infrs.weight_values.get());
     infrs.assignments_evid[variable.id] = proposal;
+    if (!should_tally) return;
 
     // bookkeep aggregates for computing marginals
     ++infrs.agg_nsamples[variable.id];
@@ -168,6 +498,52 @@ inline void GibbsSamplerThread::sample_single_variable(size_t vid) {
   }
 }
 
+inline bool GibbsSamplerThread::anneal_single_variable(
+    size_t vid, double inverse_temperature, bool is_icm) {
+  const Variable &variable = fg.variables[vid];
+  if (variable.is_evid && !sample_evidence) return false;
+
+  size_t *assignments = infrs.assignments_evid.get();
+  const size_t current = assignments[vid];
+  varlen_potential_buffer_.resize(variable.cardinality);
+  for (size_t i = 0; i < variable.cardinality; ++i) {
+    varlen_potential_buffer_[i] =
+        fg.potential(variable, i, assignments, infrs.weight_values.get());
+  }
+  double max = varlen_potential_buffer_[0];
+  size_t argmax = 0;
+  for (size_t i = 1; i < variable.cardinality; ++i) {
+    if (varlen_potential_buffer_[i] > max) {
+      max = varlen_potential_buffer_[i];
+      argmax = i;
+    }
+  }
+
+  size_t proposal = current;
+  if (is_icm) {
+    // keep the current value on ties, so the sweeps settle
+    if (varlen_potential_buffer_[current] < max) proposal = argmax;
+  } else {
+    double sum = 0;
+    for (size_t i = 0; i < variable.cardinality; ++i) {
+      varlen_potential_buffer_[i] =
+          exp(inverse_temperature * (varlen_potential_buffer_[i] - max));
+      sum += varlen_potential_buffer_[i];
+    }
+    double r = erand48(p_rand_seed) * sum;
+    proposal = variable.cardinality - 1;
+    for (size_t i = 0; i + 1 < variable.cardinality; ++i) {
+      r -= varlen_potential_buffer_[i];
+      if (r <= 0) {
+        proposal = i;
+        break;
+      }
+    }
+  }
+  assignments[vid] = proposal;
+  return proposal != current;
+}
+
 inline size_t GibbsSamplerThread::sample_evid(const Variable &variable) {
   if (!is_noise_aware && variable.is_evid) {
     // direct assignment of hard "evidence"
@@ -189,6 +565,31 @@ inline size_t GibbsSamplerThread::sample_evid(const Variable &variable) {
   }
 }
 
+inline void GibbsSamplerThread::compute_conditional(
+    const Variable &variable, const size_t assignments[],
+    const double weight_values[]) {
+  varlen_potential_buffer_.resize(variable.cardinality);
+  double sum = -100000.0;
+  for (size_t i = 0; i < variable.cardinality; ++i) {
+    varlen_potential_buffer_[i] =
+        fg.potential(variable, i, assignments, weight_values);
+    sum = logadd(sum, varlen_potential_buffer_[i]);
+  }
+  for (size_t i = 0; i < variable.cardinality; ++i) {
+    varlen_potential_buffer_[i] = exp(varlen_potential_buffer_[i] - sum);
+  }
+}
+
+inline size_t GibbsSamplerThread::draw_from_conditional(
+    const Variable &variable) {
+  double r = erand48(p_rand_seed);
+  for (size_t i = 0; i + 1 < variable.cardinality; ++i) {
+    r -= varlen_potential_buffer_[i];
+    if (r <= 0) return i;
+  }
+  return variable.cardinality - 1;
+}
+
 inline size_t GibbsSamplerThread::draw_sample(const Variable &variable,
                                               const size_t assignments[],
                                               const double weight_values[]) {
@@ -206,7 +607,9 @@ inline size_t GibbsSamplerThread::draw_sample(const Variable &variable,
       // flip a coin with probability
       // (exp(potential_pos) + exp(potential_neg)) / exp(potential_neg)
       // = exp(potential_pos - potential_neg) + 1
-      if (r * (1.0 + exp(potential_neg - potential_pos)) < 1.0) {
+      if (r * (1.0 + exp(inverse_temperature *
+                         (potential_neg - potential_pos))) <
+          1.0) {
         proposal = 1;
       } else {
         proposal = 0;
@@ -224,6 +627,7 @@ inline size_t GibbsSamplerThread::draw_sample(const Variable &variable,
           for                                                                 \
       EACH_DOMAIN_VALUE {                                                     \
         varlen_potential_buffer_[DOMAIN_INDEX] =                              \
+            inverse_temperature *                                             \
             fg.potential(variable, DOMAIN_VALUE, assignments, weight_values); \
         sum = logadd(sum, varlen_potential_buffer_[DOMAIN_INDEX]);            \
       }                                                                       \
@@ -13,7 +13,7 @@ InferenceResult::InferenceResult(const FactorGraph &fg, const CmdParser &opts)
       nvars(fg.size.num_variables),
       nweights(fg.size.num_weights),
       ntallies(fg.size.num_values),
-      sample_tallies(new size_t[fg.size.num_values]),
+      sample_tallies(new double[fg.size.num_values]),
       agg_nsamples(new size_t[nvars]),
       assignments_free(new size_t[nvars]),
       assignments_evid(new size_t[nvars]),
@@ -100,10 +100,45 @@ void InferenceResult::show_weights_snippet(std::ostream &output) const {
 
 void InferenceResult::dump_weights_in_text(std::ostream &text_output) const {
   for (size_t j = 0; j < nweights; ++j) {
-    text_output << j << " " << weight_values[j] << std::endl;
+    text_output << j << " " << weight_values[j] << "\n";
   }
 }
 
+void InferenceResult::copy_chains_to(InferenceResult &other) const {
+  assert(nvars == other.nvars);
+  COPY_ARRAY(assignments_free.get(), nvars, other.assignments_free.get());
+  COPY_ARRAY(assignments_evid.get(), nvars, other.assignments_evid.get());
+}
+
+// raw array I/O for checkpoints
+template <typename T>
+static inline void write_array(std::ostream &output, const T *array,
+                               size_t num) {
+  output.write(reinterpret_cast<const char *>(array), num * sizeof(T));
+}
+template <typename T>
+static inline void read_array(std::istream &input, T *array, size_t num) {
+  input.read(reinterpret_cast<char *>(array), num * sizeof(T));
+}
+
+void InferenceResult::save_state(std::ostream &output) const {
+  write_array(output, weight_values.get(), nweights);
+  write_array(output, weight_grads.get(), nweights);
+  write_array(output, assignments_free.get(), nvars);
+  write_array(output, assignments_evid.get(), nvars);
+  write_array(output, agg_nsamples.get(), nvars);
+  write_array(output, sample_tallies.get(), ntallies);
+}
+
+void InferenceResult::load_state(std::istream &input) {
+  read_array(input, weight_values.get(), nweights);
+  read_array(input, weight_grads.get(), nweights);
+  read_array(input, assignments_free.get(), nvars);
+  read_array(input, assignments_evid.get(), nvars);
+  read_array(input, agg_nsamples.get(), nvars);
+  read_array(input, sample_tallies.get(), ntallies);
+}
+
 void InferenceResult::clear_variabletally() {
   for (size_t i = 0; i < nvars; ++i) {
     agg_nsamples[i] = 0;
@@ -133,7 +168,7 @@ void InferenceResult::show_marginal_snippet(std::ostream &output) const {
     const Variable &variable = fg.variables[j];
     if (!variable.is_evid || opts.should_sample_evidence) {
       ++ct;
-      output << "   " << variable.id
+      output << "   " << fg.original_vid(variable.id)
              << "  NSAMPLE=" << agg_nsamples[variable.id] << std::endl;
 
       const auto &print_snippet = [this, &output, &variable](
@@ -181,7 +216,7 @@ void InferenceResult::show_marginal_histogram(std::ostream &output,
       continue;
     }
     for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
-      size_t bin = (size_t)((double)sample_tallies[variable.var_val_base + k] /
+      size_t bin = (size_t)(sample_tallies[variable.var_val_base + k] /
                             agg_nsamples[variable.id] * bins);
       if (bin <= bins) {
         ++abc[bin];
@@ -217,7 +252,7 @@ void InferenceResult::dump_marginals_in_text(std::ostream &text_output) const {
 
     const auto &print_result = [this, &text_output, &variable](
         size_t domain_value, size_t domain_index) {
-      text_output << variable.id << " " << domain_value << " "
+      text_output << fg.original_vid(variable.id) << " " << domain_value << " "
                   << 1.0 *
                          sample_tallies[variable.var_val_base + domain_index] /
                          agg_nsamples[variable.id]
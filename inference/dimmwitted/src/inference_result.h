@@ -24,7 +24,9 @@ class InferenceResult {
   size_t ntallies;  // number of tallies
 
   // tallies for each var value (see Variable.var_val_base)
-  std::unique_ptr<size_t[]> sample_tallies;
+  // NOTE: fractional tallies are allowed, e.g., exact marginals are stored as
+  // probabilities with an agg_nsamples of 1
+  std::unique_ptr<double[]> sample_tallies;
 
   // array of number of samples for each variable
   std::unique_ptr<size_t[]> agg_nsamples;
@@ -55,6 +57,14 @@ class InferenceResult {
   void copy_weights_to(InferenceResult &other) const;
   void show_weights_snippet(std::ostream &output) const;
   void dump_weights_in_text(std::ostream &text_output) const;
+  // in the format FactorGraph::load_weights reads (see binary_format.cc)
+  void dump_weights_in_binary(std::ostream &binary_output) const;
+
+  // save/seed the state of both chains, e.g., to warm start a later run
+  // (see binary_format.cc)
+  void dump_chains_in_binary(std::ostream &binary_output) const;
+  void load_chains(const std::vector<std::string> &filenames);
+  void copy_chains_to(InferenceResult &other) const;
 
   void clear_variabletally();
   void aggregate_marginals_from(const InferenceResult &other);
@@ -63,6 +73,11 @@ class InferenceResult {
                                const size_t bins = 10) const;
   void dump_marginals_in_text(std::ostream &text_output) const;
 
+  // save/load weights, gradients, both chains, and tallies in binary (host
+  // byte order) for checkpointing
+  void save_state(std::ostream &output) const;
+  void load_state(std::istream &input);
+
   inline void update_weight(size_t wid, double stepsize, double gradient) {
     weight_grads[wid] += gradient;
     double weight = weight_values[wid];
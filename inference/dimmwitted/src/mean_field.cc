@@ -0,0 +1,185 @@
+#include "mean_field.h"
+#include "common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace dd {
+
+// To placate linker error "undefined reference" (see variable.cc)
+constexpr double MeanField::MIN_DELTA;
+constexpr size_t MeanField::MAX_FACTOR_STATES;
+
+bool MeanField::can_run(const FactorGraph &fg, bool should_sample_evidence) {
+  for (size_t factor_id = 0; factor_id < fg.size.num_factors; ++factor_id) {
+    const Factor &factor = fg.factors[factor_id];
+    size_t num_states = 1;
+    for (size_t j = 0; j < factor.num_vars; ++j) {
+      const Variable &variable = fg.variables[fg.vifs[factor.vif_base + j].vid];
+      if (variable.is_evid && !should_sample_evidence) continue;
+      // checked before multiplying so it cannot overflow
+      if (num_states > MAX_FACTOR_STATES / variable.cardinality) return false;
+      num_states *= variable.cardinality;
+    }
+  }
+  return true;
+}
+
+MeanField::MeanField(const FactorGraph &fg, bool should_sample_evidence)
+    : fg_(fg),
+      is_query_(fg.size.num_variables, false),
+      q_base_(fg.size.num_variables + 1, 0),
+      factor_base_(fg.size.num_variables + 1, 0) {
+  const size_t nvar = fg.size.num_variables;
+  for (size_t vid = 0; vid < nvar; ++vid) {
+    const Variable &variable = fg.variables[vid];
+    is_query_[vid] = should_sample_evidence || !variable.is_evid;
+    q_base_[vid + 1] =
+        q_base_[vid] + (is_query_[vid] ? variable.cardinality : 0);
+
+    // the factors of a categorical variable are split by its values
+    if (is_query_[vid]) {
+      size_t begin = factor_ids_.size();
+      for (size_t k = 0; k < variable.internal_cardinality(); ++k) {
+        const VariableToFactor &var_value =
+            fg.values[variable.var_val_base + k];
+        factor_ids_.insert(
+            factor_ids_.end(), &fg.factor_index[var_value.factor_index_base],
+            &fg.factor_index[var_value.factor_index_base +
+                             var_value.factor_index_length]);
+      }
+      std::sort(factor_ids_.begin() + begin, factor_ids_.end());
+      factor_ids_.erase(
+          std::unique(factor_ids_.begin() + begin, factor_ids_.end()),
+          factor_ids_.end());
+    }
+    factor_base_[vid + 1] = factor_ids_.size();
+  }
+
+  q_.resize(q_base_[nvar]);
+  for (size_t vid = 0; vid < nvar; ++vid) {
+    for (size_t i = q_base_[vid]; i < q_base_[vid + 1]; ++i)
+      q_[i] = 1.0 / fg.variables[vid].cardinality;
+  }
+  next_q_ = q_;
+}
+
+size_t MeanField::run(const InferenceResult &infrs, size_t max_iterations,
+                      size_t n_threads) {
+  const size_t nvar = fg_.size.num_variables;
+  size_t i_iteration = 0;
+  while (i_iteration < max_iterations) {
+    ++i_iteration;
+    std::vector<double> deltas(n_threads, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; ++t) {
+      threads.push_back(std::thread([this, &infrs, &deltas, nvar, n_threads,
+                                     t]() {
+        size_t chunk = nvar / n_threads + 1;
+        deltas[t] = update(infrs, std::min(nvar, chunk * t),
+                           std::min(nvar, chunk * (t + 1)));
+      }));
+    }
+    for (auto &t : threads) t.join();
+    q_.swap(next_q_);
+    if (*std::max_element(deltas.begin(), deltas.end()) <= MIN_DELTA) break;
+  }
+  return i_iteration;
+}
+
+double MeanField::update(const InferenceResult &infrs, size_t begin,
+                         size_t end) {
+  // a copy of each factor over its own vifs and assignments, indexed by the
+  // positions of its variables, so enumerating never touches shared state
+  std::vector<FactorToVariable> vifs;
+  std::vector<size_t> assignments;
+  std::vector<size_t> others;
+  std::vector<double> log_q;
+  double max_delta = 0;
+  for (size_t vid = begin; vid < end; ++vid) {
+    if (!is_query_[vid]) continue;
+    const size_t cardinality = fg_.variables[vid].cardinality;
+    log_q.assign(cardinality, 0);
+
+    for (size_t i = factor_base_[vid]; i < factor_base_[vid + 1]; ++i) {
+      Factor factor(fg_.factors[factor_ids_[i]]);
+      vifs.resize(factor.num_vars);
+      assignments.resize(factor.num_vars);
+      others.clear();
+      for (size_t j = 0; j < factor.num_vars; ++j) {
+        const FactorToVariable &vif = fg_.vifs[factor.vif_base + j];
+        vifs[j] = FactorToVariable(j, vif.dense_equal_to);
+        assignments[j] = infrs.assignments_evid[vif.vid];
+        if (vif.vid != vid && is_query_[vif.vid]) {
+          others.push_back(j);
+          assignments[j] = 0;
+        }
+      }
+      const size_t vif_base = factor.vif_base;
+      factor.vif_base = 0;
+      const double weight = infrs.weight_values[factor.weight_id];
+
+      // expected potential with this variable at each value, over the joint
+      // assignments to the other query variables
+      for (size_t value = 0; value < cardinality; ++value) {
+        for (size_t j = 0; j < factor.num_vars; ++j)
+          if (fg_.vifs[vif_base + j].vid == vid) assignments[j] = value;
+        double expected = 0;
+        bool has_next = true;
+        while (has_next) {
+          double prob = 1;
+          for (size_t j : others)
+            prob *= probability(fg_.vifs[vif_base + j].vid, assignments[j]);
+          if (prob > 0) {
+            expected +=
+                prob * factor.potential(vifs.data(), assignments.data());
+          }
+          // next joint assignment like an odometer
+          has_next = false;
+          for (size_t j : others) {
+            size_t other = fg_.vifs[vif_base + j].vid;
+            if (++assignments[j] < fg_.variables[other].cardinality) {
+              has_next = true;
+              break;
+            }
+            assignments[j] = 0;
+          }
+        }
+        log_q[value] += weight * expected;
+      }
+    }
+
+    // damp the normalized distribution toward the previous one
+    double sum = -INFINITY;
+    for (double pot : log_q) sum = logadd(sum, pot);
+    for (size_t value = 0; value < cardinality; ++value) {
+      double prob = q_[q_base_[vid] + value];
+      double next_prob = (exp(log_q[value] - sum) + prob) / 2;
+      max_delta = std::max(max_delta, std::abs(next_prob - prob));
+      next_q_[q_base_[vid] + value] = next_prob;
+    }
+  }
+  return max_delta;
+}
+
+void MeanField::sample_chains(InferenceResult &infrs,
+                              unsigned short rand_seed[3]) const {
+  for (size_t vid = 0; vid < fg_.size.num_variables; ++vid) {
+    if (!is_query_[vid]) continue;
+    const size_t cardinality = fg_.variables[vid].cardinality;
+    size_t value = cardinality - 1;
+    double r = erand48(rand_seed);
+    for (size_t k = 0; k + 1 < cardinality; ++k) {
+      r -= probability(vid, k);
+      if (r <= 0) {
+        value = k;
+        break;
+      }
+    }
+    infrs.assignments_free[vid] = value;
+    infrs.assignments_evid[vid] = value;
+  }
+}
+
+}  // namespace dd
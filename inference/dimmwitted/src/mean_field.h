@@ -0,0 +1,84 @@
+#ifndef DIMMWITTED_MEAN_FIELD_H_
+#define DIMMWITTED_MEAN_FIELD_H_
+
+#include "factor_graph.h"
+#include "inference_result.h"
+
+#include <vector>
+
+namespace dd {
+
+/**
+ * Naive mean-field approximation of the query variables of a factor graph,
+ * i.e., independent distributions each set to the exponentiated expected
+ * potential of its factors under the others, with the evidence clamped.
+ *
+ * It is used to start the Gibbs chains near typical states instead of all
+ * zeros, which shortens the burn-in.  All variables are updated in parallel
+ * from the previous iteration, damped by keeping half of their previous
+ * distribution, which keeps such updates from oscillating.  The expected
+ * potential of a factor is computed by enumerating the joint assignments to
+ * its query variables, so the cost grows exponentially with their number,
+ * and it is capped at MAX_FACTOR_STATES of them (see can_run).
+ */
+class MeanField {
+ public:
+  // most joint assignments to the query variables of a factor to enumerate
+  static constexpr size_t MAX_FACTOR_STATES = 4096;
+
+  /**
+   * Returns whether no factor of the given factor graph has more than
+   * MAX_FACTOR_STATES joint assignments to its query variables, treating
+   * evidence as query variables too if should_sample_evidence.
+   */
+  static bool can_run(const FactorGraph &fg, bool should_sample_evidence);
+
+  /**
+   * Prepares the distributions of the given (indexed) factor graph, starting
+   * uniform, treating evidence as query variables too if
+   * should_sample_evidence.
+   */
+  MeanField(const FactorGraph &fg, bool should_sample_evidence);
+
+  /**
+   * Updates the distributions given the weights and evidence in infrs for up
+   * to max_iterations, or until none changes more than MIN_DELTA, using
+   * n_threads threads, and returns the number of iterations done.
+   */
+  size_t run(const InferenceResult &infrs, size_t max_iterations,
+             size_t n_threads);
+
+  inline double probability(size_t vid, size_t value) const {
+    return q_[q_base_[vid] + value];
+  }
+
+  /**
+   * Assigns each query variable in both chains of infrs a value drawn from
+   * its distribution.
+   */
+  void sample_chains(InferenceResult &infrs, unsigned short rand_seed[3]) const;
+
+ private:
+  // iterations stop once no probability changes more than this
+  static constexpr double MIN_DELTA = 1e-3;
+
+  const FactorGraph &fg_;
+  std::vector<bool> is_query_;
+  // distribution of each query variable at [q_base_[vid], q_base_[vid + 1])
+  // of q_, and its next one during an iteration in next_q_
+  std::vector<size_t> q_base_;
+  std::vector<double> q_;
+  std::vector<double> next_q_;
+  // factors adjacent to each query variable, each once, at
+  // [factor_base_[vid], factor_base_[vid + 1])
+  std::vector<size_t> factor_ids_;
+  std::vector<size_t> factor_base_;
+
+  // computes next_q_ of the variables [begin, end) from q_, and returns the
+  // largest change of a probability
+  double update(const InferenceResult &infrs, size_t begin, size_t end);
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_MEAN_FIELD_H_
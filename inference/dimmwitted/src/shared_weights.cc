@@ -0,0 +1,201 @@
+#include "shared_weights.h"
+
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dd {
+
+// To placate linker error "undefined reference" (see variable.cc)
+constexpr size_t SharedWeights::MAGIC;
+constexpr size_t SharedWeights::LIVENESS_CHECK_POLLS;
+
+// how long to sleep between polls while waiting for other processes
+static constexpr useconds_t POLL_INTERVAL_USEC = 100;
+
+SharedWeights::SharedWeights(const std::string &name, size_t rank,
+                             size_t nprocs, size_t nweights)
+    : name_(name.empty() || name[0] != '/' ? "/" + name : name),
+      rank_(rank),
+      nprocs_(nprocs),
+      nweights_(nweights),
+      // keep the slots cache line aligned
+      num_bytes_((sizeof(Header) + nprocs * sizeof(pid_t) + 63) / 64 * 64 +
+                 nprocs * nweights * sizeof(double)),
+      header_(nullptr),
+      pids_(nullptr),
+      slots_(nullptr) {
+  void *mem;
+  if (rank_ == 0) {
+    // create and size the shared memory, replacing any left by a crashed run
+    // but never one of a run still going
+    if (is_in_use()) {
+      std::cerr << "[ERROR] Shared memory " << name_
+                << " is in use by another run" << std::endl;
+      std::abort();
+    }
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      std::cerr << "[ERROR] Cannot create shared memory " << name_
+                << std::endl;
+      std::abort();
+    }
+    if (ftruncate(fd, num_bytes_) != 0) {
+      std::cerr << "[ERROR] Cannot allocate shared memory " << name_
+                << std::endl;
+      std::abort();
+    }
+    mem = map(fd);
+    header_ = new (mem) Header();
+    header_->owner_pid = getpid();
+    header_->barrier_count = 0;
+    header_->barrier_generation = 0;
+    header_->nprocs = nprocs_;
+    header_->nweights = nweights_;
+    header_->ready.store(MAGIC, std::memory_order_release);
+  } else {
+    // wait for rank 0 of this run to create it, passing over any left by a
+    // crashed run, whose rank 0 is gone, until rank 0 replaces it
+    std::cout << "WAITING FOR SHARED WEIGHTS " << name_ << "..." << std::endl;
+    for (;; usleep(POLL_INTERVAL_USEC)) {
+      int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+      if (fd < 0) continue;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || (size_t)st.st_size < num_bytes_) {
+        close(fd);
+        continue;
+      }
+      mem = map(fd);
+      header_ = static_cast<Header *>(mem);
+      if (header_->ready.load(std::memory_order_acquire) == MAGIC &&
+          is_alive(header_->owner_pid))
+        break;
+      munmap(mem, num_bytes_);
+    }
+    if (header_->nprocs != nprocs_ || header_->nweights != nweights_) {
+      std::cerr << "[ERROR] Shared memory " << name_ << " is for "
+                << header_->nprocs << " processes and " << header_->nweights
+                << " weights, not " << nprocs_ << " and " << nweights_
+                << std::endl;
+      std::abort();
+    }
+  }
+  pids_ = reinterpret_cast<pid_t *>(header_ + 1);
+  pids_[rank_] = getpid();
+  slots_ = reinterpret_cast<double *>(static_cast<char *>(mem) + num_bytes_ -
+                                      nprocs * nweights * sizeof(double));
+
+  // once everyone is attached, the name is no longer needed
+  barrier();
+  if (rank_ == 0) shm_unlink(name_.c_str());
+}
+
+void *SharedWeights::map(int fd) const {
+  void *mem =
+      mmap(nullptr, num_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    std::cerr << "[ERROR] Cannot map shared memory " << name_ << std::endl;
+    std::abort();
+  }
+  return mem;
+}
+
+bool SharedWeights::is_alive(pid_t pid) {
+  return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+bool SharedWeights::is_in_use() const {
+  int fd = shm_open(name_.c_str(), O_RDONLY, 0600);
+  if (fd < 0) return false;
+  struct stat st;
+  bool is_in_use = false;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Header)) {
+    void *mem = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+    if (mem != MAP_FAILED) {
+      // the pid is 0 until the owner sets it, and kill(0, 0) always succeeds
+      pid_t owner_pid = static_cast<const Header *>(mem)->owner_pid;
+      is_in_use = owner_pid > 0 && is_alive(owner_pid);
+      munmap(mem, sizeof(Header));
+    }
+  }
+  close(fd);
+  return is_in_use;
+}
+
+void SharedWeights::check_alive() const {
+  for (size_t i = 0; i < nprocs_; ++i) {
+    pid_t pid = pids_[i];
+    if (pid > 0 && !is_alive(pid)) {
+      std::cerr << "[ERROR] Process " << pid << " of rank " << i
+                << " sharing weights " << name_ << " died" << std::endl;
+      std::abort();
+    }
+  }
+}
+
+SharedWeights::~SharedWeights() {
+  if (header_) munmap(header_, num_bytes_);
+}
+
+void SharedWeights::barrier() {
+  size_t generation =
+      header_->barrier_generation.load(std::memory_order_acquire);
+  if (header_->barrier_count.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+      nprocs_) {
+    // last one to arrive releases the others
+    header_->barrier_count.store(0, std::memory_order_relaxed);
+    header_->barrier_generation.fetch_add(1, std::memory_order_release);
+  } else {
+    // a process that died would never arrive
+    for (size_t n_polls = 1;
+         header_->barrier_generation.load(std::memory_order_acquire) ==
+         generation;
+         ++n_polls) {
+      usleep(POLL_INTERVAL_USEC);
+      if (n_polls % LIVENESS_CHECK_POLLS == 0) check_alive();
+    }
+  }
+}
+
+void SharedWeights::start_from(const InferenceResult &infrs) {
+  assert(infrs.nweights == nweights_);
+  base_.assign(infrs.weight_values.get(),
+               infrs.weight_values.get() + nweights_);
+}
+
+void SharedWeights::average(InferenceResult &infrs) {
+  assert(infrs.nweights == nweights_);
+  if (base_.empty()) start_from(infrs);
+
+  // make sure everyone has read the previous round before overwriting
+  barrier();
+  double *slot = slots_ + rank_ * nweights_;
+  for (size_t j = 0; j < nweights_; ++j)
+    slot[j] = infrs.weight_values[j] - base_[j];
+  barrier();
+
+  // a weight of no factor a process visited stays exactly the same there
+  for (size_t j = 0; j < nweights_; ++j) {
+    if (infrs.weights_isfixed[j]) continue;
+    double sum = 0;
+    size_t num_changed = 0;
+    for (size_t i = 0; i < nprocs_; ++i) {
+      double change = slots_[i * nweights_ + j];
+      if (change == 0) continue;
+      sum += change;
+      ++num_changed;
+    }
+    if (num_changed > 0) base_[j] += sum / num_changed;
+    infrs.weight_values[j] = base_[j];
+  }
+}
+
+}  // namespace dd
@@ -0,0 +1,103 @@
+#ifndef DIMMWITTED_SHARED_WEIGHTS_H_
+#define DIMMWITTED_SHARED_WEIGHTS_H_
+
+#include "inference_result.h"
+
+#include <atomic>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+namespace dd {
+
+/**
+ * Weights shared by multiple dw processes through POSIX shared memory, e.g.,
+ * one process per factor graph partition learning concurrently.
+ *
+ * Each process publishes the changes to its weights since the last sync into
+ * its own slot of a shared array, and every weight moves by the average
+ * change over the processes that changed it, so a weight that only the
+ * factors of one partition have keeps its whole update, while those shared
+ * by several get averaged like InferenceResult::merge_weights_from and
+ * average_weights do for the copies on different NUMA nodes within a
+ * process.
+ */
+class SharedWeights {
+ public:
+  /**
+   * Attaches to the shared memory object with the given name, which the
+   * process of rank 0 creates and the others wait for. Returns once all
+   * nprocs processes have attached. The name is unlinked right after, so it
+   * must be unique to the run but can be reused by the next one. An object
+   * left by a crashed run gets replaced by rank 0, and the others wait for
+   * the new one instead of attaching to it, as its rank 0 is gone, but rank 0
+   * aborts if the rank 0 of another run still uses the name.
+   */
+  SharedWeights(const std::string &name, size_t rank, size_t nprocs,
+                size_t nweights);
+
+  ~SharedWeights();
+
+  /**
+   * Records the weights learning starts from, i.e., the same in all
+   * processes, to which the changes get applied at the first average.
+   */
+  void start_from(const InferenceResult &infrs);
+
+  /**
+   * Replaces the non-fixed weights with those at the last sync moved by the
+   * average change since across the processes that changed them.
+   * Blocks until every process calls this, so all processes must call it the
+   * same number of times, and aborts if one of them dies meanwhile.
+   */
+  void average(InferenceResult &infrs);
+
+ private:
+  // layout at the beginning of the shared memory
+  struct Header {
+    std::atomic<size_t> ready;  // MAGIC once rank 0 has initialized
+    std::atomic<size_t> barrier_count;
+    std::atomic<size_t> barrier_generation;
+    size_t nprocs;
+    size_t nweights;
+    // rank 0 of the run, to tell a segment left by a crashed run
+    pid_t owner_pid;
+  };
+
+  static constexpr size_t MAGIC = 0xd1331177edUL;
+
+  // polls between checks that all processes still run while waiting
+  static constexpr size_t LIVENESS_CHECK_POLLS = 1000;
+
+  // maps num_bytes_ of the given shared memory, and closes it
+  void *map(int fd) const;
+
+  // whether the process with the given id still runs
+  static bool is_alive(pid_t pid);
+
+  // whether an object of the name exists whose rank 0 still runs
+  bool is_in_use() const;
+
+  // aborts if a process attached before has died
+  void check_alive() const;
+
+  // waits for all processes to reach this point
+  void barrier();
+
+  std::string name_;
+  size_t rank_;
+  size_t nprocs_;
+  size_t nweights_;
+  size_t num_bytes_;
+  Header *header_;
+  // process id of each rank once it has attached, or 0
+  pid_t *pids_;
+  // nprocs_ slots of nweights_ weight changes each
+  double *slots_;
+  // weights at the last sync
+  std::vector<double> base_;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_SHARED_WEIGHTS_H_
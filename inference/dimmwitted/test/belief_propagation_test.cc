@@ -0,0 +1,58 @@
+/**
+ * Unit tests for loopy belief propagation
+ */
+
+#include "belief_propagation.h"
+#include "partial_observation_test.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, with C = 9 made a query variable as well
+class BeliefPropagationTest : public PartialObservationTest {
+ protected:
+  BeliefPropagationTest() : PartialObservationTest({9}) {}
+};
+
+// test the beliefs against the exact marginals, as the graph is a forest
+TEST_F(BeliefPropagationTest, run_on_forest) {
+  BeliefPropagation bp(*fg, false);
+  size_t n_iterations = bp.run(*infrs, 100, 0.5, 1e-9, 2);
+  EXPECT_LT(n_iterations, 100U);
+  bp.store_marginals(*infrs);
+
+  // potential of (b, c) given a = 1 is 0.5 * [b = a] + 2 * [b = c] in +/-1
+  double z = 0, p_b = 0, p_c = 0;
+  for (int b = 0; b < 2; ++b) {
+    for (int c = 0; c < 2; ++c) {
+      double p = exp(0.5 * (b == 1 ? 1 : -1) + 2 * (b == c ? 1 : -1));
+      z += p;
+      if (b == 1) p_b += p;
+      if (c == 1) p_c += p;
+    }
+  }
+  EXPECT_EQ(infrs->agg_nsamples[5], 1U);
+  EXPECT_EQ(infrs->agg_nsamples[0], 0U);  // evidence
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[5].var_val_base], p_b / z,
+              1e-6);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[9].var_val_base], p_c / z,
+              1e-6);
+  double p_b_alone = 1 / (1 + exp(-2 * 0.5 - 2 * 2));
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[6].var_val_base], p_b_alone,
+              1e-6);
+}
+
+// test marginals computed beforehand are kept
+TEST_F(BeliefPropagationTest, store_marginals_keeps_others) {
+  infrs->agg_nsamples[6] = 1;
+  infrs->sample_tallies[fg->variables[6].var_val_base] = 0.25;
+  BeliefPropagation bp(*fg, false);
+  bp.run(*infrs, 10, 0, 0, 1);
+  bp.store_marginals(*infrs);
+  EXPECT_EQ(infrs->sample_tallies[fg->variables[6].var_val_base], 0.25);
+  EXPECT_EQ(infrs->agg_nsamples[7], 1U);
+}
+
+}  // namespace dd
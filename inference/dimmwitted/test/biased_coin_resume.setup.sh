@@ -0,0 +1,4 @@
+#!/usr/bin/env bash
+cd "$(dirname "$0")"
+# start over instead of resuming from the checkpoint of an earlier test run
+rm -f biased_coin_resume/inference_result.checkpoint*
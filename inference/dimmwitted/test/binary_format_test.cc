@@ -55,6 +55,37 @@ TEST(BinaryFormatTest, read_weights) {
   EXPECT_EQ(fg.weights[0].weight, 0.0);
 }
 
+// test writing learned weights that can be read back
+TEST(BinaryFormatTest, dump_weights_in_binary) {
+  const char *argv[] = {
+      "dw", "gibbs", "-m", "./test/biased_coin/graph.meta",
+      "-l", "0",     "-i", "0",
+  };
+  CmdParser cmd_parser(sizeof(argv) / sizeof(*argv), argv);
+  FactorGraph fg({1, 1, 1, 1});
+  fg.load_weights({"./test/biased_coin/graph.weights"});
+  InferenceResult infrs(fg, fg.weights.get(), cmd_parser);
+  infrs.weight_values[0] = 1.5;
+  {
+    std::ofstream fout("./test/biased_coin/learned.weights.bin",
+                       std::ios::binary);
+    infrs.dump_weights_in_binary(fout);
+  }
+
+  // as the weights of a factor graph
+  FactorGraph fg2({1, 1, 1, 1});
+  fg2.load_weights({"./test/biased_coin/learned.weights.bin"});
+  EXPECT_EQ(fg2.size.num_weights, 1U);
+  EXPECT_EQ(fg2.weights[0].id, 0U);
+  EXPECT_EQ(fg2.weights[0].isfixed, false);
+  EXPECT_EQ(fg2.weights[0].weight, 1.5);
+
+  // or overriding the values of those loaded
+  fg.load_weight_values({"./test/biased_coin/learned.weights.bin"});
+  EXPECT_EQ(fg.size.num_weights, 1U);
+  EXPECT_EQ(fg.weights[0].weight, 1.5);
+}
+
 // test read domains
 TEST(BinaryFormatTest, read_domains) {
   size_t num_variables = 3;
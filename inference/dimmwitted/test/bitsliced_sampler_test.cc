@@ -0,0 +1,59 @@
+/**
+ * Unit tests for sampling 64 chains at once
+ */
+
+#include "bitsliced_sampler.h"
+#include "partial_observation_test.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, with C = 9 made a query variable as well
+class BitslicedSamplerTest : public PartialObservationTest {
+ protected:
+  BitslicedSamplerTest() : PartialObservationTest({9}) {}
+};
+
+// test which factor graphs can be sampled
+TEST_F(BitslicedSamplerTest, can_sample) {
+  EXPECT_TRUE(BitslicedSampler::can_sample(*fg));
+  fg->factors[0].func_id = FUNC_LINEAR;
+  EXPECT_FALSE(BitslicedSampler::can_sample(*fg));
+}
+
+// test the marginals against the exact ones
+TEST_F(BitslicedSamplerTest, sample) {
+  BitslicedSampler sampler(*fg, *infrs, false);
+  sampler.sample(*infrs, 10, 2, false);
+  sampler.sample(*infrs, 1000, 2);
+  EXPECT_EQ(infrs->agg_nsamples[6], 64000U);
+  EXPECT_EQ(infrs->agg_nsamples[0], 0U);
+
+  // a variable with only evidence around
+  double p_b_alone = 1 / (1 + exp(-2 * 0.5 - 2 * 2));
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[6].var_val_base] / 64000,
+              p_b_alone, 0.01);
+
+  // B = 5 and C = 9 by enumerating their joint assignments
+  double z = 0, p_b = 0, p_c = 0;
+  for (size_t b = 0; b < 2; ++b) {
+    for (size_t c = 0; c < 2; ++c) {
+      double p = exp(0.5 * (b == 1 ? 1 : -1) + 2 * (b == c ? 1 : -1));
+      z += p;
+      p_b += b * p;
+      p_c += c * p;
+    }
+  }
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[5].var_val_base] / 64000,
+              p_b / z, 0.01);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[9].var_val_base] / 64000,
+              p_c / z, 0.01);
+
+  // evidence stays put in the evid chain
+  sampler.store_chain(*infrs);
+  EXPECT_EQ(infrs->assignments_evid[0], 1U);
+}
+
+}  // namespace dd
@@ -0,0 +1,69 @@
+/**
+ * Unit tests for blocked sampling of chains
+ */
+
+#include "chain_sampler.h"
+#include "partial_observation_test.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, with B = 4 and C = {8, 9} made query variables as
+// well
+class ChainSamplerTest : public PartialObservationTest {
+ protected:
+  ChainSamplerTest() : PartialObservationTest({4, 8, 9}) {}
+};
+
+// test finding the chains among the variables to sample
+TEST_F(ChainSamplerTest, find_chains) {
+  std::vector<size_t> vids;
+  for (size_t vid = 0; vid < 12; ++vid) vids.push_back(vid);
+  ChainSampler chains(*fg, vids);
+  EXPECT_EQ(chains.num_chains(), 2U);
+  EXPECT_EQ(chains.size_of(0), 2U);
+  EXPECT_EQ(chains.size_of(1), 2U);
+
+  // B = {6, 7} are left alone with only evidence around
+  EXPECT_EQ(vids, std::vector<size_t>({0, 1, 2, 3, 6, 7, 10, 11}));
+
+  // a variable not given to sample does not link the others
+  std::vector<size_t> vids2({4, 5, 9});
+  ChainSampler chains2(*fg, vids2);
+  EXPECT_EQ(chains2.num_chains(), 1U);
+  EXPECT_EQ(vids2, std::vector<size_t>({4}));
+}
+
+// test the frequencies of the joint samples against the exact marginals
+TEST_F(ChainSamplerTest, sample) {
+  std::vector<size_t> vids({5, 9});
+  ChainSampler chains(*fg, vids);
+  ASSERT_EQ(chains.num_chains(), 1U);
+
+  unsigned short seed[3] = {1, 2, 3};
+  std::vector<double> buffer;
+  const size_t n_samples = 20000;
+  for (size_t i = 0; i < n_samples; ++i)
+    chains.sample(0, *fg, *infrs, seed, true, buffer);
+
+  // potential of (b, c) given a = 1 is 0.5 * [b = a] + 2 * [b = c] in +/-1
+  double z = 0, p_b = 0, p_c = 0;
+  for (int b = 0; b < 2; ++b) {
+    for (int c = 0; c < 2; ++c) {
+      double p = exp(0.5 * (b == 1 ? 1 : -1) + 2 * (b == c ? 1 : -1));
+      z += p;
+      if (b == 1) p_b += p;
+      if (c == 1) p_c += p;
+    }
+  }
+  EXPECT_EQ(infrs->agg_nsamples[5], n_samples);
+  EXPECT_EQ(infrs->agg_nsamples[9], n_samples);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[5].var_val_base] / n_samples,
+              p_b / z, 0.02);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[9].var_val_base] / n_samples,
+              p_c / z, 0.02);
+}
+
+}  // namespace dd
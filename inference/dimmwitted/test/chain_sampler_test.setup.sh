@@ -0,0 +1 @@
+partial_observation.setup.sh
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * Unit tests for connected components
+ */
+
+#include "components.h"
+#include "partial_observation_test.h"
+#include <fstream>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, whose first chain has no query variable
+class ComponentsTest : public PartialObservationTest {};
+
+// test labeling components
+TEST_F(ComponentsTest, label) {
+  ConnectedComponents components(*fg, 2);
+  EXPECT_EQ(components.num_components, 4U);
+  for (size_t c = 0; c < 4; ++c) {
+    EXPECT_EQ(components.size_of(c), 3U);
+    // numbered by the smallest variable id, with ids increasing
+    EXPECT_EQ(components.vids[components.component_base[c]], c);
+    EXPECT_EQ(components.vids[components.component_base[c] + 1], c + 4);
+    EXPECT_EQ(components.vids[components.component_base[c] + 2], c + 8);
+    EXPECT_EQ(components.component_of[c + 8], c);
+    EXPECT_TRUE(components.has_evidence[c]);
+    EXPECT_EQ(components.has_query[c], c > 0);
+  }
+}
+
+// test pruning components without query variables
+TEST_F(ComponentsTest, inference_vids) {
+  ConnectedComponents components(*fg, 1);
+  std::vector<size_t> vids = components.inference_vids(false);
+  std::vector<size_t> expected = {1, 5, 9, 2, 6, 10, 3, 7, 11};
+  EXPECT_EQ(vids, expected);
+  EXPECT_EQ(components.inference_vids(true).size(), 12U);
+}
+
+// test writing the map of components for variational.cc
+TEST_F(ComponentsTest, dump) {
+  ConnectedComponents components(*fg, 1);
+  components.dump(*fg, "./test/partial_observation");
+
+  std::ifstream fin_comps("./test/partial_observation/mat_components_hasevids");
+  size_t cid, has_evid, n = 0;
+  while (fin_comps >> cid >> has_evid) {
+    EXPECT_EQ(cid, n++);
+    EXPECT_EQ(has_evid, 1U);
+  }
+  EXPECT_EQ(n, 3U);
+
+  std::ifstream fin_vars("./test/partial_observation/mat_active_components");
+  size_t vid;
+  n = 0;
+  while (fin_vars >> vid >> cid) {
+    EXPECT_EQ(cid, vid % 4 - 1);
+    ++n;
+  }
+  EXPECT_EQ(n, 9U);
+}
+
+// test components after reordering the variables, which puts each chain
+// together, while the dump still has the original ids
+TEST_F(ComponentsTest, reorder_by_locality) {
+  fg.reset(new FactorGraph({12, 8, 2, 16}));
+  fg->load_variables({"./test/partial_observation/graph.variables"});
+  fg->load_weights({"./test/partial_observation/graph.weights"});
+  fg->load_factors({"./test/partial_observation/graph.factors"});
+  fg->safety_check();
+  fg->reorder_by_locality();
+  fg->safety_check();
+  fg->construct_index();
+  for (size_t vid = 0; vid < 12; ++vid) {
+    EXPECT_EQ(fg->original_vid(vid), vid / 3 + vid % 3 * 4);
+    EXPECT_EQ(fg->reordered_vid(fg->original_vid(vid)), vid);
+  }
+  const Factor &factor = fg->factors[1];
+  EXPECT_EQ(fg->get_factor_vif_at(factor, 0).vid, 1U);
+  EXPECT_EQ(fg->get_factor_vif_at(factor, 1).vid, 2U);
+
+  ConnectedComponents components(*fg, 2);
+  EXPECT_EQ(components.num_components, 4U);
+  for (size_t vid = 0; vid < 12; ++vid)
+    EXPECT_EQ(components.component_of[vid], vid / 3);
+
+  components.dump(*fg, "./test/partial_observation");
+  std::ifstream fin_vars("./test/partial_observation/mat_active_components");
+  size_t vid, cid;
+  while (fin_vars >> vid >> cid) EXPECT_EQ(cid, vid % 4 - 1);
+}
+
+}  // namespace dd
@@ -0,0 +1,61 @@
+/**
+ * Unit tests for exact inference of small components
+ */
+
+#include "exact_inference.h"
+#include "partial_observation_test.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, with C = 9 made a query variable as well
+class ExactInferenceTest : public PartialObservationTest {
+ protected:
+  ExactInferenceTest() : PartialObservationTest({9}) {}
+};
+
+// test picking components by the number of joint assignments
+TEST_F(ExactInferenceTest, pick_components) {
+  ConnectedComponents components(*fg, 1);
+  ExactInference exact(*fg, components, 4);
+  EXPECT_EQ(exact.num_components(), 3U);
+  EXPECT_FALSE(exact.is_exact[0]);  // no query variable
+  EXPECT_TRUE(exact.is_exact[1]);
+
+  // the component with both 5 and 9 has 4 joint assignments
+  ExactInference exact2(*fg, components, 3);
+  EXPECT_EQ(exact2.num_components(), 2U);
+  EXPECT_FALSE(exact2.is_exact[1]);
+  EXPECT_TRUE(exact2.is_exact[2]);
+}
+
+// test the marginals against enumerating by hand
+TEST_F(ExactInferenceTest, compute_marginals) {
+  ConnectedComponents components(*fg, 1);
+  ExactInference exact(*fg, components, 4096);
+  exact.compute_marginals(*infrs, 2);
+
+  // potential of (b, c) given a = 1 is 0.5 * [b = a] + 2 * [b = c] in +/-1
+  double z = 0, p_b = 0, p_c = 0;
+  for (int b = 0; b < 2; ++b) {
+    for (int c = 0; c < 2; ++c) {
+      double p = exp(0.5 * (b == 1 ? 1 : -1) + 2 * (b == c ? 1 : -1));
+      z += p;
+      if (b == 1) p_b += p;
+      if (c == 1) p_c += p;
+    }
+  }
+  EXPECT_EQ(infrs->agg_nsamples[5], 1U);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[5].var_val_base], p_b / z,
+              1e-9);
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[9].var_val_base], p_c / z,
+              1e-9);
+  // the other chains with only B unobserved
+  double p_b_alone = 1 / (1 + exp(-2 * 0.5 - 2 * 2));
+  EXPECT_NEAR(infrs->sample_tallies[fg->variables[6].var_val_base], p_b_alone,
+              1e-9);
+}
+
+}  // namespace dd
@@ -65,4 +65,118 @@ TEST_F(FactorGraphTest, sgd_on_variable) {
   EXPECT_EQ(infrs->weight_values[0], 0.2);
 }
 
+// test has_only_unary_factors function
+TEST_F(FactorGraphTest, has_only_unary_factors) {
+  EXPECT_TRUE(cfg->has_only_unary_factors());
+
+  cfg->factors[0].num_vars = 2;
+  EXPECT_FALSE(cfg->has_only_unary_factors());
+}
+
+// test has_observed_markov_blanket function
+TEST_F(FactorGraphTest, has_observed_markov_blanket) {
+  EXPECT_TRUE(cfg->has_observed_markov_blanket(cfg->variables[10]));
+
+  // extend the factor of variable 10 to variable 11, which is not evidence
+  Factor &factor = cfg->factors[10];
+  ASSERT_EQ(cfg->get_factor_vif_at(factor, 0).vid, 10U);
+  ASSERT_EQ(cfg->vifs[factor.vif_base + 1].vid, 11U);
+  factor.num_vars = 2;
+  EXPECT_FALSE(cfg->has_observed_markov_blanket(cfg->variables[10]));
+}
+
+// test simplify_given_evidence function
+// the factor of variable 10 is extended to evidence variable 0 (true) or 8
+// (false) in place of variable 11
+TEST_F(FactorGraphTest, simplify_given_evidence) {
+  Factor &factor = cfg->factors[10];
+  const VariableToFactor &var_value =
+      cfg->values[cfg->variables[10].var_val_base];
+  ASSERT_EQ(var_value.factor_index_length, 1U);
+  factor.num_vars = 2;
+  size_t num_constant, num_stripped;
+
+  // an OR with a false literal does not need it
+  factor.func_id = FUNC_OR;
+  cfg->vifs[factor.vif_base + 1] = FactorToVariable(8, 1);
+  cfg->simplify_given_evidence(num_constant, num_stripped);
+  EXPECT_EQ(num_constant, 0U);
+  EXPECT_EQ(num_stripped, 1U);
+  EXPECT_EQ(factor.num_vars, 1U);
+  EXPECT_EQ(cfg->get_factor_vif_at(factor, 0).vid, 10U);
+
+  // an IMPLY with a true head is still up to its body
+  factor.num_vars = 2;
+  factor.func_id = FUNC_IMPLY_NATURAL;
+  cfg->vifs[factor.vif_base + 1] = FactorToVariable(0, 1);
+  cfg->simplify_given_evidence(num_constant, num_stripped);
+  EXPECT_EQ(num_constant, 0U);
+  EXPECT_EQ(num_stripped, 0U);
+  EXPECT_EQ(factor.num_vars, 2U);
+
+  // but the MLN one is always true
+  factor.func_id = FUNC_IMPLY_MLN;
+  cfg->simplify_given_evidence(num_constant, num_stripped);
+  EXPECT_EQ(num_constant, 1U);
+  EXPECT_EQ(var_value.factor_index_length, 0U);
+}
+
+// test deduplicate_factors function
+TEST_F(FactorGraphTest, deduplicate_factors) {
+  FactorGraph fg({18, 18, 1, 18});
+  fg.load_variables(cmd_parser->variable_file);
+  fg.load_weights(cmd_parser->weight_file);
+  fg.load_domains(cmd_parser->domain_file);
+  fg.load_factors(cmd_parser->factor_file);
+  ASSERT_EQ(fg.get_factor_vif_at(fg.factors[10], 0).vid, 10U);
+
+  // the factor of variable 11 becomes a copy of that of variable 10
+  fg.vifs[fg.factors[11].vif_base] = fg.get_factor_vif_at(fg.factors[10], 0);
+  EXPECT_EQ(fg.deduplicate_factors(), 1U);
+  EXPECT_EQ(fg.size.num_factors, 17U);
+  EXPECT_EQ(fg.size.num_edges, 17U);
+  EXPECT_EQ(fg.factors[10].feature_value, 2);
+  EXPECT_EQ(fg.factors[11].id, 11U);
+  EXPECT_EQ(fg.get_factor_vif_at(fg.factors[11], 0).vid, 12U);
+  fg.safety_check();
+
+  fg.construct_index();
+  EXPECT_EQ(fg.values[fg.variables[10].var_val_base].factor_index_length, 1U);
+  EXPECT_EQ(fg.values[fg.variables[11].var_val_base].factor_index_length, 0U);
+  const VariableToFactor &var_value =
+      fg.values[fg.variables[12].var_val_base];
+  ASSERT_EQ(var_value.factor_index_length, 1U);
+  EXPECT_EQ(fg.factor_index[var_value.factor_index_base], 11U);
+}
+
+// test fold_unary_factors function
+TEST_F(FactorGraphTest, fold_unary_factors) {
+  const Variable &variable = cfg->variables[10];
+  double pos = cfg->potential(variable, 1, infrs->assignments_evid.get(),
+                              infrs->weight_values.get());
+  double neg = cfg->potential(variable, 0, infrs->assignments_evid.get(),
+                              infrs->weight_values.get());
+
+  // every factor of biased coin is unary, so the lists become empty while
+  // the potentials stay the same
+  EXPECT_EQ(cfg->fold_unary_factors(infrs->weight_values.get()), 18U);
+  EXPECT_EQ(cfg->values[variable.var_val_base].factor_index_length, 0U);
+  EXPECT_DOUBLE_EQ(cfg->potential(variable, 1, infrs->assignments_evid.get(),
+                                  infrs->weight_values.get()),
+                   pos);
+  EXPECT_DOUBLE_EQ(cfg->potential(variable, 0, infrs->assignments_evid.get(),
+                                  infrs->weight_values.get()),
+                   neg);
+
+  // folding again follows the weights
+  infrs->weight_values[0] *= 2;
+  EXPECT_EQ(cfg->fold_unary_factors(infrs->weight_values.get()), 18U);
+  EXPECT_DOUBLE_EQ(cfg->potential(variable, 1, infrs->assignments_evid.get(),
+                                  infrs->weight_values.get()),
+                   2 * pos);
+  EXPECT_DOUBLE_EQ(cfg->potential(variable, 0, infrs->assignments_evid.get(),
+                                  infrs->weight_values.get()),
+                   2 * neg);
+}
+
 }  // namespace dd
@@ -0,0 +1,65 @@
+/**
+ * Unit tests for the mean-field initialization of chains
+ */
+
+#include "mean_field.h"
+#include "partial_observation_test.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace dd {
+
+// test fixture
+// on partial observation, with C = 9 made a query variable as well
+class MeanFieldTest : public PartialObservationTest {
+ protected:
+  MeanFieldTest() : PartialObservationTest({9}) {}
+};
+
+// test the distributions against a fixed point of the updates
+TEST_F(MeanFieldTest, run) {
+  EXPECT_TRUE(MeanField::can_run(*fg, false));
+  MeanField mean_field(*fg, false);
+  size_t n_iterations = mean_field.run(*infrs, 1000, 2);
+  EXPECT_LT(n_iterations, 1000U);
+
+  // exact for a variable with only evidence around
+  double p_b_alone = 1 / (1 + exp(-2 * 0.5 - 2 * 2));
+  EXPECT_NEAR(mean_field.probability(6, 1), p_b_alone, 1e-2);
+  EXPECT_NEAR(mean_field.probability(6, 0) + mean_field.probability(6, 1), 1,
+              1e-9);
+
+  // B = 5 and C = 9 each see the other's expected value in +/-1
+  double q_b = mean_field.probability(5, 1);
+  double q_c = mean_field.probability(9, 1);
+  EXPECT_NEAR(q_b, 1 / (1 + exp(-2 * (0.5 + 2 * (2 * q_c - 1)))), 1e-2);
+  EXPECT_NEAR(q_c, 1 / (1 + exp(-2 * (2 * (2 * q_b - 1)))), 1e-2);
+  EXPECT_GT(q_c, 0.5);
+}
+
+// test factors with too many joint assignments to their query variables
+TEST_F(MeanFieldTest, can_run) {
+  fg->variables[5].cardinality = MeanField::MAX_FACTOR_STATES;
+  EXPECT_FALSE(MeanField::can_run(*fg, false));
+  // unless the other is evidence too
+  fg->variables[9].is_evid = true;
+  EXPECT_TRUE(MeanField::can_run(*fg, false));
+  EXPECT_FALSE(MeanField::can_run(*fg, true));
+}
+
+// test drawing the chains only changes the query variables
+TEST_F(MeanFieldTest, sample_chains) {
+  MeanField mean_field(*fg, false);
+  mean_field.run(*infrs, 1000, 1);
+  unsigned short seed[3] = {1, 2, 3};
+  size_t n_true = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    mean_field.sample_chains(*infrs, seed);
+    EXPECT_EQ(infrs->assignments_evid[9], infrs->assignments_free[9]);
+    EXPECT_EQ(infrs->assignments_evid[0], 1U);
+    n_true += infrs->assignments_evid[9];
+  }
+  EXPECT_NEAR(n_true / 1000.0, mean_field.probability(9, 1), 0.05);
+}
+
+}  // namespace dd
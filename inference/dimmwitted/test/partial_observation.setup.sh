@@ -0,0 +1,5 @@
+#!/usr/bin/env bash
+cd "$(dirname "$0")"
+dw text2bin variable partial_observation/variables.tsv partial_observation/graph.variables /dev/stderr
+dw text2bin factor   partial_observation/factors.tsv   partial_observation/graph.factors /dev/stderr   3 2 1 1
+dw text2bin weight   partial_observation/weights.tsv   partial_observation/graph.weights /dev/stderr
@@ -0,0 +1 @@
+.end_to_end_test.bats.template
\ No newline at end of file
@@ -0,0 +1,55 @@
+/**
+ * Test fixture for the unit tests on the partial observation factor graph
+ */
+
+#ifndef DIMMWITTED_TEST_PARTIAL_OBSERVATION_TEST_H_
+#define DIMMWITTED_TEST_PARTIAL_OBSERVATION_TEST_H_
+
+#include "dimmwitted.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace dd {
+
+// the factor graph is from partial observation, which contains 4 chains A-B-C
+// of 3 variables each: A = {0, 1, 2, 3}, B = {4, 5, 6, 7}, and C = {8, 9, 10,
+// 11}, with EQUAL factors of weight 0 between A and B, and of weight 1 between
+// B and C, set to 0.5 and 2 in infrs. All are evidence with value 1 except
+// B = {5, 6, 7}, and those given to the constructor are made query variables
+// as well.
+class PartialObservationTest : public testing::Test {
+ protected:
+  std::unique_ptr<FactorGraph> fg;
+  std::unique_ptr<InferenceResult> infrs;
+  std::unique_ptr<CmdParser> cmd_parser;
+
+  explicit PartialObservationTest(const std::vector<size_t> &query_vids = {})
+      : query_vids_(query_vids) {}
+
+  virtual void SetUp() {
+    const char *argv[] = {
+        "dw", "gibbs", "-m", "./test/partial_observation/graph.meta",
+        "-l", "0",     "-i", "0",
+    };
+    cmd_parser.reset(new CmdParser(sizeof(argv) / sizeof(*argv), argv));
+
+    fg.reset(new FactorGraph({12, 8, 2, 16}));
+    fg->load_variables({"./test/partial_observation/graph.variables"});
+    fg->load_weights({"./test/partial_observation/graph.weights"});
+    fg->load_factors({"./test/partial_observation/graph.factors"});
+    fg->safety_check();
+    fg->construct_index();
+    for (size_t vid : query_vids_) fg->variables[vid].is_evid = false;
+
+    infrs.reset(new InferenceResult(*fg, fg->weights.get(), *cmd_parser));
+    infrs->weight_values[0] = 0.5;
+    infrs->weight_values[1] = 2;
+  }
+
+ private:
+  std::vector<size_t> query_vids_;
+};
+
+}  // namespace dd
+
+#endif  // DIMMWITTED_TEST_PARTIAL_OBSERVATION_TEST_H_
@@ -13,8 +13,10 @@ for what in variable domain factor weight; do
     done
 done
 
-# run sampler
-dw gibbs \
+# run sampler, in the mode given by dw-mode if any
+mode=gibbs
+! [[ -e dw-mode ]] || mode=$(cat dw-mode)
+dw "$mode" \
     -w <(cat 2>/dev/null graph.weights*) \
     -v <(cat 2>/dev/null graph.variables*) \
     -f <(cat 2>/dev/null graph.factors*) \
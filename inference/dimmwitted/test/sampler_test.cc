@@ -7,6 +7,7 @@
 #include "dimmwitted.h"
 #include "factor_graph.h"
 #include "gibbs_sampler.h"
+#include <cmath>
 #include <fstream>
 #include <gtest/gtest.h>
 
@@ -65,6 +66,18 @@ TEST_F(SamplerTest, sample_sgd_single_variable) {
   EXPECT_EQ(infrs->weight_values[0], 0.2);
 }
 
+// test for pseudo_likelihood_sgd_single_variable
+// with weight 0, an evidence variable at 1 has conditional 0.5, so the
+// gradient is 0.5 * (-1) + (0.5 - 1) * 1 = -1
+TEST_F(SamplerTest, pseudo_likelihood_sgd_single_variable) {
+  sampler->pseudo_likelihood_sgd_single_variable(0, 0.1);
+  EXPECT_NEAR(infrs->weight_values[0], 0.1, 1e-9);
+
+  // query variables do not contribute
+  sampler->pseudo_likelihood_sgd_single_variable(10, 0.1);
+  EXPECT_NEAR(infrs->weight_values[0], 0.1, 1e-9);
+}
+
 // test for sample_single_variable
 TEST_F(SamplerTest, sample_single_variable) {
   infrs->assignments_free[cfg->variables[0].id] = 1;
@@ -85,4 +98,95 @@ TEST_F(SamplerTest, sample_single_variable) {
   EXPECT_EQ(infrs->assignments_evid[12], 1U);
 }
 
+// test for sample_single_variable during burn-in
+TEST_F(SamplerTest, sample_single_variable_without_tally) {
+  sampler->sample_single_variable(10U, false);
+  EXPECT_EQ(infrs->agg_nsamples[10], 0U);
+
+  sampler->sample_single_variable(10U);
+  EXPECT_EQ(infrs->agg_nsamples[10], 1U);
+}
+
+// test for sample_single_variable tallying conditionals
+// with weight 0, a query variable is 1 with probability 0.5 regardless of
+// what is drawn
+TEST_F(SamplerTest, sample_single_variable_rao_blackwellized) {
+  const char *argv[] = {
+      "dw", "gibbs", "-m", "./test/biased_coin/graph.meta",
+      "-l", "0",     "-i", "0",
+      "--rao_blackwell",
+  };
+  CmdParser opts(sizeof(argv) / sizeof(*argv), argv);
+  GibbsSamplerThread rb_sampler(*cfg, *infrs, 0, 1, opts);
+
+  rb_sampler.sample_single_variable(10U);
+  rb_sampler.sample_single_variable(10U);
+  EXPECT_EQ(infrs->agg_nsamples[10], 2U);
+  EXPECT_NEAR(infrs->sample_tallies[cfg->variables[10].var_val_base], 1.0,
+              1e-9);
+}
+
+// test for sample_single_variable at a high temperature, as in parallel
+// tempering, where a strong weight barely matters
+TEST_F(SamplerTest, sample_single_variable_at_temperature) {
+  sampler->set_random_seed(1, 1, 1);
+  infrs->weight_values[0] = 2;
+  sampler->set_temperature(1000);
+  for (size_t i = 0; i < 2000; ++i) sampler->sample_single_variable(10U);
+  EXPECT_NEAR(infrs->sample_tallies[cfg->variables[10].var_val_base] / 2000,
+              0.5, 0.05);
+
+  sampler->set_temperature(1);
+  for (size_t i = 0; i < 2000; ++i) sampler->sample_single_variable(11U);
+  EXPECT_NEAR(infrs->sample_tallies[cfg->variables[11].var_val_base] / 2000,
+              1 / (1 + exp(-4.0)), 0.05);
+}
+
+// test for sample in adaptive-scan inference, where the query variables all
+// flip about as often, so each is still visited about once per epoch and its
+// marginal is the average of its own samples
+TEST_F(SamplerTest, sample_adaptively) {
+  const char *argv[] = {
+      "dw", "gibbs", "-m", "./test/biased_coin/graph.meta",
+      "-l", "0",     "-i", "0",
+      "--adaptive_scan", "0.1", "--force_gibbs",
+  };
+  CmdParser opts(sizeof(argv) / sizeof(*argv), argv);
+  GibbsSamplerThread adaptive_sampler(*cfg, *infrs, 0, 1, opts);
+  adaptive_sampler.set_random_seed(1, 1, 1);
+  infrs->weight_values[0] = 2;
+
+  for (size_t i = 0; i < 2000; ++i) adaptive_sampler.sample();
+  for (size_t vid = 10; vid < 18; ++vid) {
+    EXPECT_NEAR(infrs->agg_nsamples[vid], 2000U, 500U);
+    EXPECT_NEAR(infrs->sample_tallies[cfg->variables[vid].var_val_base] /
+                    infrs->agg_nsamples[vid],
+                1 / (1 + exp(-4.0)), 0.05);
+  }
+  // evidence is not sampled
+  EXPECT_EQ(infrs->agg_nsamples[0], 0U);
+}
+
+// test for saving the chains and seeding them back
+TEST_F(SamplerTest, dump_and_load_chains) {
+  infrs->assignments_free[8] = 1;
+  infrs->assignments_free[10] = 1;
+  infrs->assignments_evid[8] = 1;
+  infrs->assignments_evid[11] = 1;
+  {
+    std::ofstream fout("./test/biased_coin/chains.bin", std::ios::binary);
+    infrs->dump_chains_in_binary(fout);
+  }
+
+  InferenceResult seeded(*cfg, cfg->weights.get(), *cmd_parser);
+  seeded.load_chains({"./test/biased_coin/chains.bin"});
+  EXPECT_EQ(seeded.assignments_free[8], 1U);
+  EXPECT_EQ(seeded.assignments_free[10], 1U);
+  EXPECT_EQ(seeded.assignments_free[11], 0U);
+  EXPECT_EQ(seeded.assignments_evid[10], 0U);
+  EXPECT_EQ(seeded.assignments_evid[11], 1U);
+  // evidence stays at its value unless it is sampled
+  EXPECT_EQ(seeded.assignments_evid[8], 0U);
+}
+
 }  // namespace dd
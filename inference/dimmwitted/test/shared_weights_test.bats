@@ -0,0 +1 @@
+.gtest.bats.template
\ No newline at end of file
@@ -0,0 +1,100 @@
+/**
+ * Unit tests for sharing weights across processes
+ */
+
+#include "dimmwitted.h"
+#include "shared_weights.h"
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace dd {
+
+// test fixture
+// uses the biased coin factor graph, which has a single weight
+class SharedWeightsTest : public testing::Test {
+ protected:
+  std::unique_ptr<FactorGraph> cfg;
+  std::unique_ptr<InferenceResult> infrs[2];
+  std::unique_ptr<CmdParser> cmd_parser;
+
+  virtual void SetUp() {
+    const char* argv[] = {
+        "dw",      "gibbs",
+        "-w",      "./test/biased_coin/graph.weights",
+        "-v",      "./test/biased_coin/graph.variables",
+        "-f",      "./test/biased_coin/graph.factors",
+        "-m",      "./test/biased_coin/graph.meta",
+        "-o",      ".",
+        "-l",      "100",
+        "-i",      "100",
+        "--alpha", "0.1",
+    };
+    cmd_parser.reset(new CmdParser(sizeof(argv) / sizeof(*argv), argv));
+
+    cfg.reset(new FactorGraph({18, 18, 1, 18}));
+    cfg->load_variables(cmd_parser->variable_file);
+    cfg->load_weights(cmd_parser->weight_file);
+    cfg->load_domains(cmd_parser->domain_file);
+    cfg->load_factors(cmd_parser->factor_file);
+    cfg->safety_check();
+    cfg->construct_index();
+
+    for (auto& infrs_i : infrs)
+      infrs_i.reset(new InferenceResult(*cfg, cfg->weights.get(), *cmd_parser));
+  }
+};
+
+// test for average across two sharers, each attaching from its own thread
+// as a separate process would
+TEST_F(SharedWeightsTest, average) {
+  std::string name =
+      "/dw_shared_weights_test." + std::to_string((long long)getpid());
+  infrs[0]->weight_values[0] = 1;
+  infrs[1]->weight_values[0] = 1;
+
+  std::vector<std::thread> threads;
+  for (size_t rank = 0; rank < 2; ++rank) {
+    threads.push_back(std::thread([this, &name, rank]() {
+      SharedWeights shared_weights(name, rank, 2, 1);
+      shared_weights.start_from(*infrs[rank]);
+
+      // a change by one keeps its whole size
+      if (rank == 1) infrs[rank]->weight_values[0] += 2;
+      shared_weights.average(*infrs[rank]);
+      EXPECT_EQ(infrs[rank]->weight_values[0], 3);
+
+      // changes by both are averaged
+      infrs[rank]->weight_values[0] += rank == 0 ? 1 : 3;
+      shared_weights.average(*infrs[rank]);
+      EXPECT_EQ(infrs[rank]->weight_values[0], 5);
+
+      // averaging again without changes is idempotent
+      shared_weights.average(*infrs[rank]);
+      EXPECT_EQ(infrs[rank]->weight_values[0], 5);
+    }));
+  }
+  for (auto& t : threads) t.join();
+}
+
+// test for another run taking over the name while the first one attaches
+TEST_F(SharedWeightsTest, name_in_use) {
+  std::string name =
+      "/dw_shared_weights_test.in_use." + std::to_string((long long)getpid());
+  std::thread first(
+      [&name]() { SharedWeights shared_weights(name, 0, 2, 1); });
+  // wait for its rank 0 to create and initialize the object
+  int fd;
+  while ((fd = shm_open(name.c_str(), O_RDONLY, 0600)) < 0) usleep(100);
+  close(fd);
+  usleep(100000);
+
+  EXPECT_DEATH(SharedWeights(name, 0, 2, 1), "in use");
+
+  SharedWeights shared_weights(name, 1, 2, 1);
+  first.join();
+}
+
+}  // namespace dd
@@ -0,0 +1 @@
+biased_coin.setup.sh
\ No newline at end of file